@@ -0,0 +1,88 @@
+// ------------------------------------------------------------------------------------------------
+// Streams the records out of a sensor trace file.
+// ------------------------------------------------------------------------------------------------
+#include "sensortracereader.h"
+
+#include <string.h>
+
+// The size of the read buffer.
+constexpr size_t k_read_buffer_size = 1 << 20;
+
+sensortracereader::~sensortracereader() {
+  if (file_) fclose(file_);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Open a trace and check its header.
+// ------------------------------------------------------------------------------------------------
+bool sensortracereader::open(const char* path) {
+  file_ = fopen(path, "rb");
+  if (!file_) return false;
+
+  setvbuf(file_, nullptr, _IOFBF, k_read_buffer_size);
+
+  char magic[sizeof(k_sensor_trace_magic)];
+  if (fread(magic, 1, sizeof(magic), file_) != sizeof(magic)) return false;
+
+  t_ = 0;
+
+  return memcmp(magic, k_sensor_trace_magic, sizeof(magic)) == 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Read a trace from memory.
+// ------------------------------------------------------------------------------------------------
+bool sensortracereader::open(const uint8_t* data, size_t size) {
+  if (size < sizeof(k_sensor_trace_magic)) return false;
+  if (memcmp(data, k_sensor_trace_magic, sizeof(k_sensor_trace_magic)) != 0) return false;
+
+  data_ = data + sizeof(k_sensor_trace_magic);
+  end_ = data + size;
+  t_ = 0;
+
+  return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Read the next record.
+// ------------------------------------------------------------------------------------------------
+bool sensortracereader::next(sensortracerecord& record) {
+  uint32_t tag;
+  if ((!file_ && !data_) || !get_varint(tag)) return false;
+
+  t_ += tag >> 2;
+
+  record.t = t_;
+  record.type = static_cast<sensortracetype>(tag & 0x3);
+  record.value = 0;
+
+  if (record.type == sensortracetype::vane) {
+    uint32_t value;
+    if (!get_varint(value)) return false;
+    record.value = static_cast<uint16_t>(value);
+  }
+
+  return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Read a varint.
+// ------------------------------------------------------------------------------------------------
+bool sensortracereader::get_varint(uint32_t& value) {
+  value = 0;
+
+  for (int shift = 0; shift < 35; shift += 7) {
+    int c;
+    if (file_)
+      c = getc(file_);
+    else
+      c = data_ < end_ ? *data_++ : EOF;
+
+    if (c == EOF) return false;
+
+    value |= static_cast<uint32_t>(c & 0x7f) << shift;
+    if (!(c & 0x80)) return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,54 @@
+// ------------------------------------------------------------------------------------------------
+// Streams the records out of a sensor trace file.
+//
+// The file is read through a large buffer one record at a time, so traces of any length
+// can be replayed without loading them into memory. A trace that is already in memory, eg
+// mapped with mmap() and shared between processes, can be read in place instead.
+// See src/sensortrace.h for the format.
+// ------------------------------------------------------------------------------------------------
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "sensortrace.h"
+
+// A decoded record, the time is absolute in microseconds from the start of the trace.
+struct sensortracerecord {
+  uint64_t t;
+  sensortracetype type;
+  uint16_t value;
+};
+
+class sensortracereader {
+
+public:
+
+  ~sensortracereader();
+
+  // Open a trace and check its header.
+  // Returns false if the file cannot be opened or is not a sensor trace.
+  bool open(const char* path);
+
+  // Read a trace from memory, the memory must stay valid while the reader is in use.
+  // Returns false if it is not a sensor trace.
+  bool open(const uint8_t* data, size_t size);
+
+  // Read the next record.
+  // Returns false at the end of the trace or if the trace is truncated.
+  bool next(sensortracerecord& record);
+
+private:
+
+  // Read a varint, returns false at the end of the file.
+  bool get_varint(uint32_t& value);
+
+  FILE* file_ = nullptr;
+
+  // The trace in memory, and the end of it.
+  const uint8_t* data_ = nullptr;
+  const uint8_t* end_ = nullptr;
+
+  // The time of the last record read.
+  uint64_t t_ = 0;
+};
@@ -0,0 +1,106 @@
+// ------------------------------------------------------------------------------------------------
+// Decodes TX20 frames from a timeline of Txd edges.
+// ------------------------------------------------------------------------------------------------
+#include "tx20decoder.h"
+
+// ------------------------------------------------------------------------------------------------
+// Constructor.
+// ------------------------------------------------------------------------------------------------
+tx20decoder::tx20decoder(tx20framefn fn, void* context, uint32_t bit_length)
+  : fn_{ fn }, context_{ context }, bit_length_{ bit_length } {
+}
+
+// ------------------------------------------------------------------------------------------------
+// Add an edge.
+// ------------------------------------------------------------------------------------------------
+void tx20decoder::edge(uint64_t t, bool level) {
+  flush(t);
+
+  if (level == level_) return;
+  level_ = level;
+
+  if (in_frame_) {
+    if (edge_count_ < k_bit_count + 1) {
+      edge_t_[edge_count_] = t;
+      edge_level_[edge_count_] = level;
+      ++edge_count_;
+    }
+  }
+  else if (level) {
+    // A rising edge starts a frame.
+    in_frame_ = true;
+    frame_t_ = t;
+    edge_t_[0] = t;
+    edge_level_[0] = true;
+    edge_count_ = 1;
+  }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Decode the current frame if it has finished by t.
+// ------------------------------------------------------------------------------------------------
+void tx20decoder::flush(uint64_t t) {
+  if (in_frame_ && t >= frame_t_ + static_cast<uint64_t>(k_bit_count + k_end_slack) * bit_length_) {
+    in_frame_ = false;
+    decode();
+  }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Rebuild the bits from the edges, resyncing the bit clock on each one, and check the fields.
+// ------------------------------------------------------------------------------------------------
+void tx20decoder::decode() {
+  uint64_t bits = 0;
+
+  // The last edge and the bit boundary it was put on.
+  uint64_t sync_t = edge_t_[0];
+  int sync_bit = 0;
+
+  bool level = edge_level_[0];
+  int bit = 0;
+
+  for (int i = 1; i <= edge_count_ && bit < k_bit_count; ++i) {
+    int end = k_bit_count;
+
+    if (i < edge_count_) {
+      end = sync_bit + static_cast<int>((edge_t_[i] - sync_t + bit_length_ / 2) / bit_length_);
+      if (end > k_bit_count) end = k_bit_count;
+
+      sync_t = edge_t_[i];
+      sync_bit = end;
+    }
+
+    for (; bit < end; ++bit)
+      if (!level) bits |= 1ull << bit;
+
+    if (i < edge_count_) level = edge_level_[i];
+  }
+
+  // The header is 00100, sent first bit first.
+  if ((bits & 0x1f) != 0x04) {
+    ++bad_headers_;
+    return;
+  }
+
+  tx20frame frame;
+  frame.t = frame_t_;
+  frame.direction = (bits >> 5) & 0xf;
+  frame.speed = (bits >> 9) & 0xfff;
+  frame.errors = tx20_error_none;
+
+  const unsigned checksum = (bits >> 21) & 0xf;
+  const unsigned direction2 = (bits >> 25) & 0xf;
+  const unsigned speed2 = (bits >> 29) & 0xfff;
+
+  const unsigned expected = (frame.direction + (frame.speed & 0xf) + ((frame.speed >> 4) & 0xf) +
+                             ((frame.speed >> 8) & 0xf)) & 0xf;
+
+  if (checksum != expected) frame.errors |= tx20_error_checksum;
+  if (direction2 != (~frame.direction & 0xfu)) frame.errors |= tx20_error_direction;
+  if (speed2 != (~frame.speed & 0xfffu)) frame.errors |= tx20_error_speed;
+
+  ++frames_;
+  if (frame.errors) ++bad_frames_;
+
+  if (fn_) fn_(context_, frame);
+}
@@ -0,0 +1,99 @@
+// ------------------------------------------------------------------------------------------------
+// Decodes TX20 frames from a timeline of Txd edges.
+//
+// This is the reverse of tx20encoder::encode(). The line sits low between frames
+// and a frame starts with a rising edge. Like a UART the decoder resyncs on every edge,
+// each edge is put on the nearest bit boundary and the bits after it are counted from
+// there, so a bit length error only has to stay under half a bit across the longest run
+// without an edge rather than across the whole frame. A high line is a 0 bit and a low
+// line is a 1 bit. The 41 bit frame is,
+//    header 00100, direction (4), speed (12), checksum (4), ~direction (4), ~speed (12)
+// with all fields sent least significant bit first.
+// ------------------------------------------------------------------------------------------------
+#pragma once
+
+#include <stdint.h>
+
+// The errors that can be found in a frame.
+enum tx20frameerror : uint8_t {
+  tx20_error_none = 0,
+  tx20_error_checksum = 1,
+  tx20_error_direction = 2,
+  tx20_error_speed = 4
+};
+
+// A decoded frame.
+struct tx20frame {
+  // The time in microseconds of the start of the frame.
+  uint64_t t;
+
+  // The wind direction, 0=N, 4=E etc.
+  uint8_t direction;
+
+  // The wind speed in units of 0.1 m/s.
+  uint16_t speed;
+
+  // A combination of tx20frameerror, zero if the frame is good.
+  uint8_t errors;
+};
+
+// Called for each frame that has a valid header.
+using tx20framefn = void (*)(void* context, const tx20frame& frame);
+
+class tx20decoder {
+
+public:
+
+  // The bit length is in microseconds and should match the emulator's.
+  tx20decoder(tx20framefn fn, void* context, uint32_t bit_length = 2000);
+
+  // Add an edge, the level is that of the line after time t.
+  // Writes that do not change the level are ignored.
+  void edge(uint64_t t, bool level);
+
+  // Decode any frame that has finished by time t.
+  void flush(uint64_t t);
+
+  // Statistics.
+  uint32_t frames() const { return frames_; }
+  uint32_t bad_frames() const { return bad_frames_; }
+  uint32_t bad_headers() const { return bad_headers_; }
+
+private:
+
+  // Decode the frame in edges_.
+  void decode();
+
+  // The number of bits in a frame.
+  static constexpr int k_bit_count = 41;
+
+  // The extra bits allowed after a frame before it is decoded, a slow transmitter's last
+  // edges land after the nominal end of the frame.
+  static constexpr int k_end_slack = 4;
+
+  // The frame callback.
+  tx20framefn fn_;
+  void* context_;
+
+  // The length of a bit in microseconds.
+  uint32_t bit_length_;
+
+  // The current level of the line.
+  bool level_ = true;
+
+  // True while a frame is being collected.
+  bool in_frame_ = false;
+
+  // The start time of the frame being collected.
+  uint64_t frame_t_ = 0;
+
+  // The edges in the current frame, the first is always the rising start edge.
+  // A frame has at most one edge per bit.
+  uint64_t edge_t_[k_bit_count + 1];
+  bool edge_level_[k_bit_count + 1];
+  int edge_count_ = 0;
+
+  uint32_t frames_ = 0;
+  uint32_t bad_frames_ = 0;
+  uint32_t bad_headers_ = 0;
+};
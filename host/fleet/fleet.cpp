@@ -0,0 +1,544 @@
+// ------------------------------------------------------------------------------------------------
+// A fleet of virtual TX20 bridges for load testing the station server.
+//
+// Each bridge runs the unmodified davis6410 and tx20emulator classes on the simulated
+// Arduino, fed by its own wind, with Dtr held low so that it sends a frame every 2.5 s. The
+// frames are decoded from Txd and written out at the wall clock time they finish, either as
+// decoded frames or as the raw Txd edges, to a pseudo terminal per bridge or to stdout.
+//
+//    fleet [-n bridges] [-s seconds] [-x speed] [-f frames|edges] [-o pty|stdout|none]
+//          [-t trace]
+//
+//    -n  the number of bridges, the default is 100
+//    -s  how long to run for in wall clock seconds, the default is 60
+//    -x  virtual seconds per wall clock second, eg 10 sends frames 10 times as often
+//    -f  what is written for each frame, the default is frames
+//           frames - "<bridge> <direction> <direction name> <speed 0.1 m/s> <ok|bad>"
+//           edges - one "<bridge> <virtual time us> <level>" line per Txd edge
+//    -o  where it is written, the default is pty and the names of the pseudo terminals
+//        are printed at the start, one "bridge <n> <path>" line each
+//    -t  replay the anemometer and vane from a sensor trace rather than a synthetic wind,
+//        each bridge starts at a different point in it
+//
+// The classes keep their interrupt state in file statics and the simulator is global, so
+// each bridge is a process of its own. A bridge only wakes when it has a frame to send, it
+// runs its simulation ahead to the end of the next frame and then sleeps until the wall
+// clock catches up, so thousands of bridges can share one machine. The aggregate frame
+// rate and the timing fidelity are printed every second on stderr,
+//    late - how far after its due time a frame was written, mean and max
+//    cadence - the largest error in the spacing of the frames in virtual time
+// ------------------------------------------------------------------------------------------------
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "davis6410.h"
+#include "pins.h"
+#include "sensortracereader.h"
+#include "sim.h"
+#include "tx20decoder.h"
+#include "tx20emulator.h"
+
+// The virtual time each pass of the main loop takes.
+constexpr uint64_t k_loop_us = 1000;
+
+// The frame interval, and the time from the start of a frame until it can be decoded.
+constexpr uint64_t k_frame_interval = 2500000;
+constexpr uint64_t k_frame_length = (k_tx20_frame_bits + k_tx20_trailing_bits) * k_tx20_bit_length;
+
+// The synthetic wind has a mean of between these speeds, and changes every k_gust_interval.
+constexpr uint32_t k_min_mean_mph = 3;
+constexpr uint32_t k_max_mean_mph = 30;
+constexpr uint64_t k_gust_interval = 3000000;
+
+// How often the totals are printed, in nanoseconds.
+constexpr int64_t k_report_interval = 1000000000;
+
+// What is written for each frame and where to.
+enum class fleetformat { frames, edges };
+enum class fleetsink { pty, out, none };
+
+struct fleetconfig {
+  int bridges = 100;
+  double seconds = 60;
+  double speed = 1;
+  fleetformat format = fleetformat::frames;
+  fleetsink sink = fleetsink::pty;
+  std::vector<sensortracerecord> trace;
+};
+
+// The statistics of a bridge, kept in memory shared with the parent.
+struct bridgestats {
+  std::atomic<uint64_t> frames;
+  std::atomic<uint64_t> bad;
+  std::atomic<uint64_t> late_total;
+  std::atomic<uint64_t> late_max;
+  std::atomic<uint64_t> cadence_max;
+  std::atomic<uint64_t> dropped;
+};
+
+// The state of a bridge shared with the callbacks.
+struct bridge {
+  int index;
+  const fleetconfig* config;
+  uint64_t rng;
+
+  // The synthetic wind.
+  uint32_t mean_mph = 0;
+  uint64_t pulse_interval = 0;
+  uint64_t next_pulse_t = 0;
+  uint64_t next_gust_t = 0;
+  int vane = 0;
+
+  // The replayed wind, the trace is played from index with its times moved by offset.
+  size_t trace_index = 0;
+  uint64_t trace_offset = 0;
+
+  // The frames decoded and not yet written, and the Txd edges since the last one.
+  tx20decoder* decoder = nullptr;
+  std::vector<tx20frame> frames;
+  std::vector<std::pair<uint64_t, bool>> edges;
+  bool txd = false;
+  std::string text;
+};
+
+// ------------------------------------------------------------------------------------------------
+// Return a pseudo random number in the range lo to hi.
+// ------------------------------------------------------------------------------------------------
+static uint32_t random_range(uint64_t& rng, uint32_t lo, uint32_t hi) {
+  // xorshift64
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+
+  return lo + static_cast<uint32_t>(rng % (static_cast<uint64_t>(hi) - lo + 1));
+}
+
+// ------------------------------------------------------------------------------------------------
+// Return the monotonic wall clock in nanoseconds.
+// ------------------------------------------------------------------------------------------------
+static int64_t wall_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_until(int64_t t) {
+  timespec ts;
+  ts.tv_sec = t / 1000000000LL;
+  ts.tv_nsec = t % 1000000000LL;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+}
+
+// ------------------------------------------------------------------------------------------------
+// The synthetic wind, pulses at the current speed and a gust every k_gust_interval that
+// changes the speed and moves the vane a little.
+// ------------------------------------------------------------------------------------------------
+static void synthetic_input(void* context) {
+  bridge* self = static_cast<bridge*>(context);
+  const uint64_t t = sim_time();
+
+  if (t >= self->next_gust_t) {
+    const uint32_t mph = self->mean_mph * random_range(self->rng, 50, 150) / 100;
+    self->pulse_interval = mph ? k_wind_speed_sample_t * 1000ull / mph : 0;
+    self->next_pulse_t = t + self->pulse_interval;
+    self->next_gust_t = t + k_gust_interval;
+
+    self->vane += static_cast<int>(random_range(self->rng, 0, 60)) - 30;
+    if (self->vane < 50) self->vane = 50;
+    if (self->vane > 970) self->vane = 970;
+    sim_set_analog(k_wind_direction_pin, self->vane);
+  }
+  else {
+    sim_set_pin(k_wind_sensor_pin, HIGH);
+    sim_set_pin(k_wind_sensor_pin, LOW);
+    self->next_pulse_t += self->pulse_interval;
+  }
+
+  if (self->pulse_interval && self->next_pulse_t < self->next_gust_t)
+    sim_set_next_input(self->next_pulse_t);
+  else
+    sim_set_next_input(self->next_gust_t);
+}
+
+// ------------------------------------------------------------------------------------------------
+// The replayed wind, the trace loops when it gets to the end.
+// Dtr is held low by the fleet, so the Dtr records in the trace are skipped.
+// ------------------------------------------------------------------------------------------------
+static void trace_input(void* context) {
+  bridge* self = static_cast<bridge*>(context);
+  const std::vector<sensortracerecord>& trace = self->config->trace;
+  const sensortracerecord& record = trace[self->trace_index];
+
+  if (record.type == sensortracetype::pulse) {
+    sim_set_pin(k_wind_sensor_pin, HIGH);
+    sim_set_pin(k_wind_sensor_pin, LOW);
+  }
+  else if (record.type == sensortracetype::vane) {
+    sim_set_analog(k_wind_direction_pin, record.value);
+  }
+
+  if (++self->trace_index == trace.size()) {
+    self->trace_index = 0;
+    self->trace_offset += trace.back().t;
+  }
+
+  sim_set_next_input(self->trace_offset + trace[self->trace_index].t);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Decode the Txd writes, and keep the frames and edges until it is time to write them.
+// ------------------------------------------------------------------------------------------------
+static void keep_frame(void* context, const tx20frame& frame) {
+  static_cast<bridge*>(context)->frames.push_back(frame);
+}
+
+static void watch_txd(void* context, uint64_t t, bool level) {
+  bridge* self = static_cast<bridge*>(context);
+  self->decoder->edge(t, level);
+
+  // Only the writes that change the level are edges.
+  if (level == self->txd) return;
+  self->txd = level;
+
+  if (self->config->format == fleetformat::edges) self->edges.push_back({ t, level });
+}
+
+// ------------------------------------------------------------------------------------------------
+// Write a frame, or the edges up to the end of it.
+// Writes don't block, if nothing is reading the output the text is dropped.
+// ------------------------------------------------------------------------------------------------
+static void write_frame(bridge* self, const tx20frame& frame, int fd, bridgestats& stats) {
+  char line[80];
+  self->text.clear();
+
+  if (self->config->format == fleetformat::frames) {
+    snprintf(line, sizeof(line), "%d %d %s %d %s\n", self->index, frame.direction,
+             winddrn_to_string(frame.direction), frame.speed, frame.errors ? "bad" : "ok");
+    self->text = line;
+  }
+  else {
+    const uint64_t end_t = frame.t + k_frame_length;
+    size_t n = 0;
+
+    for (; n < self->edges.size() && self->edges[n].first <= end_t; ++n) {
+      snprintf(line, sizeof(line), "%d %llu %d\n", self->index,
+               static_cast<unsigned long long>(self->edges[n].first), self->edges[n].second);
+      self->text += line;
+    }
+
+    self->edges.erase(self->edges.begin(), self->edges.begin() + n);
+  }
+
+  if (fd < 0) return;
+
+  const ssize_t written = write(fd, self->text.data(), self->text.size());
+  if (written < static_cast<ssize_t>(self->text.size()))
+    stats.dropped += self->text.size() - (written > 0 ? written : 0);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Run a bridge until the end time.
+// ------------------------------------------------------------------------------------------------
+static void run_bridge(const fleetconfig& config, int index, int fd, bridgestats& stats,
+                       int64_t wall_start, int64_t wall_end) {
+  bridge self;
+  self.index = index;
+  self.config = &config;
+  self.rng = 0x9e3779b97f4a7c15ull * (index + 1);
+
+  // Each bridge starts at a different point in the micros() cycle, so the fleet covers the
+  // wrap, and takes Dtr low at a different time, so the frames are spread out.
+  const uint64_t start_t = random_range(self.rng, 0, 0xffffffff);
+  sim_reset(start_t);
+  sim_set_serial_output(nullptr);
+
+  tx20decoder decoder(keep_frame, &self);
+  self.decoder = &decoder;
+  sim_watch_pin(k_txd_pin, watch_txd, &self);
+  sim_set_pin(k_dtr_pin, HIGH);
+
+  davis6410 wind_meter(k_wind_sensor_pin, k_wind_direction_pin);
+  tx20emulator tx20_emulator(k_dtr_pin, k_txd_pin);
+
+  wind_meter.initialise();
+  wind_meter.set_direction_mode(davis6410direction::run_weighted);
+  wind_meter.set_speed_mode(davis6410speed::interpolated);
+  tx20_emulator.initialise(&wind_meter);
+
+  if (config.trace.empty()) {
+    self.mean_mph = random_range(self.rng, k_min_mean_mph, k_max_mean_mph);
+    self.vane = random_range(self.rng, 50, 970);
+    sim_set_input(synthetic_input, &self, start_t);
+  }
+  else {
+    self.trace_index = random_range(self.rng, 0, config.trace.size() - 1);
+    self.trace_offset = start_t - config.trace[self.trace_index].t;
+    sim_set_input(trace_input, &self, start_t);
+  }
+
+  const uint64_t dtr_t = start_t + random_range(self.rng, 0, k_frame_interval);
+  bool polling = false;
+
+  uint64_t last_frame_t = 0;
+
+  while (wall_ns() < wall_end) {
+    // Run ahead to the next frame.
+    while (self.frames.empty()) {
+      if (!polling && sim_time() >= dtr_t) {
+        sim_set_pin(k_dtr_pin, LOW);
+        polling = true;
+      }
+
+      wind_meter.service();
+      tx20_emulator.service();
+      sim_advance_to(sim_time() + k_loop_us);
+
+      decoder.flush(sim_time());
+    }
+
+    const tx20frame frame = self.frames.front();
+    self.frames.erase(self.frames.begin());
+
+    // The frame is written when it has finished going out.
+    const int64_t due = wall_start + static_cast<int64_t>((frame.t + k_frame_length - start_t) * 1000 / config.speed);
+    if (due >= wall_end) break;
+
+    sleep_until(due);
+    const uint64_t late = (wall_ns() - due) / 1000;
+
+    write_frame(&self, frame, fd, stats);
+
+    ++stats.frames;
+    if (frame.errors) ++stats.bad;
+    stats.late_total += late;
+    if (late > stats.late_max) stats.late_max = late;
+
+    if (last_frame_t) {
+      const int64_t error = static_cast<int64_t>(frame.t - last_frame_t) - static_cast<int64_t>(k_frame_interval);
+      const uint64_t cadence = error < 0 ? -error : error;
+      if (cadence > stats.cadence_max) stats.cadence_max = cadence;
+    }
+    last_frame_t = frame.t;
+  }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Load a sensor trace into memory. It is shared by all the bridges.
+// The trace is looped, so one whose records all have the same time is rejected as it would
+// replay forever without the clock moving on.
+// ------------------------------------------------------------------------------------------------
+static bool load_trace(const char* path, std::vector<sensortracerecord>& trace) {
+  sensortracereader reader;
+  if (!reader.open(path)) {
+    fprintf(stderr, "fleet: %s is not a sensor trace\n", path);
+    return false;
+  }
+
+  sensortracerecord record;
+  while (reader.next(record))
+    if (record.type == sensortracetype::pulse || record.type == sensortracetype::vane) trace.push_back(record);
+
+  if (trace.empty()) {
+    fprintf(stderr, "fleet: %s has no pulse or vane records\n", path);
+    return false;
+  }
+
+  if (trace.back().t == trace.front().t) {
+    fprintf(stderr, "fleet: %s spans no time, so it can't be looped\n", path);
+    return false;
+  }
+
+  return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Open a pseudo terminal for a bridge, in raw mode with a master that doesn't block.
+// Returns the master, or -1.
+// ------------------------------------------------------------------------------------------------
+static int open_pty(std::string& path) {
+  int master;
+  int slave;
+  char name[64];
+
+  if (openpty(&master, &slave, name, nullptr, nullptr) < 0) return -1;
+
+  termios tio;
+  if (tcgetattr(slave, &tio) == 0) {
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+  }
+  close(slave);
+
+  fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+  path = name;
+  return master;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Print the totals over all the bridges.
+// ------------------------------------------------------------------------------------------------
+static void report(const char* label, const bridgestats* stats, int count, double seconds, uint64_t last_frames) {
+  uint64_t frames = 0, bad = 0, late_total = 0, late_max = 0, cadence_max = 0, dropped = 0;
+
+  for (int i = 0; i < count; ++i) {
+    frames += stats[i].frames;
+    bad += stats[i].bad;
+    late_total += stats[i].late_total;
+    dropped += stats[i].dropped;
+    if (stats[i].late_max > late_max) late_max = stats[i].late_max;
+    if (stats[i].cadence_max > cadence_max) cadence_max = stats[i].cadence_max;
+  }
+
+  fprintf(stderr, "fleet: %s %llu frames, %.1f frames/s, %llu bad, late mean %llu us max %llu us, "
+          "cadence max %llu us, %llu bytes dropped\n", label,
+          static_cast<unsigned long long>(frames), seconds > 0 ? (frames - last_frames) / seconds : 0.0,
+          static_cast<unsigned long long>(bad),
+          static_cast<unsigned long long>(frames ? late_total / frames : 0),
+          static_cast<unsigned long long>(late_max), static_cast<unsigned long long>(cadence_max),
+          static_cast<unsigned long long>(dropped));
+}
+
+static uint64_t total_frames(const bridgestats* stats, int count) {
+  uint64_t frames = 0;
+  for (int i = 0; i < count; ++i) frames += stats[i].frames;
+  return frames;
+}
+
+int main(int argc, char* argv[]) {
+  fleetconfig config;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:s:x:f:o:t:")) != -1) {
+    switch (opt) {
+      case 'n': config.bridges = atoi(optarg); break;
+      case 's': config.seconds = atof(optarg); break;
+      case 'x': config.speed = atof(optarg); break;
+
+      case 'f': {
+          if (!strcmp(optarg, "frames")) config.format = fleetformat::frames;
+          else if (!strcmp(optarg, "edges")) config.format = fleetformat::edges;
+          else config.bridges = 0;
+          break;
+        }
+
+      case 'o': {
+          if (!strcmp(optarg, "pty")) config.sink = fleetsink::pty;
+          else if (!strcmp(optarg, "stdout")) config.sink = fleetsink::out;
+          else if (!strcmp(optarg, "none")) config.sink = fleetsink::none;
+          else config.bridges = 0;
+          break;
+        }
+
+      case 't': {
+          if (!load_trace(optarg, config.trace)) return 1;
+          break;
+        }
+
+      default:
+        config.bridges = 0;
+        break;
+    }
+  }
+
+  if (config.bridges <= 0 || config.seconds <= 0 || config.speed <= 0) {
+    fprintf(stderr, "usage: fleet [-n bridges] [-s seconds] [-x speed] [-f frames|edges] "
+                    "[-o pty|stdout|none] [-t trace]\n");
+    return 2;
+  }
+
+  // The statistics are in memory shared with the bridges.
+  void* shared = mmap(nullptr, config.bridges * sizeof(bridgestats), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED) {
+    perror("fleet: mmap");
+    return 1;
+  }
+
+  bridgestats* stats = static_cast<bridgestats*>(shared);
+  for (int i = 0; i < config.bridges; ++i) new (&stats[i]) bridgestats();
+
+  // Writes to a pipe or pty with no reader should fail rather than kill the bridge.
+  signal(SIGPIPE, SIG_IGN);
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+
+  const int64_t wall_start = wall_ns();
+  const int64_t wall_end = wall_start + static_cast<int64_t>(config.seconds * 1e9);
+
+  std::vector<pid_t> children;
+
+  for (int i = 0; i < config.bridges; ++i) {
+    int fd = -1;
+
+    if (config.sink == fleetsink::pty) {
+      std::string path;
+      fd = open_pty(path);
+      if (fd < 0) {
+        perror("fleet: openpty");
+        break;
+      }
+      printf("bridge %d %s\n", i, path.c_str());
+    }
+    else if (config.sink == fleetsink::out) {
+      fd = STDOUT_FILENO;
+    }
+
+    fflush(stdout);
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+      perror("fleet: fork");
+      if (fd >= 0 && fd != STDOUT_FILENO) close(fd);
+      break;
+    }
+
+    if (pid == 0) {
+      run_bridge(config, i, fd, stats[i], wall_start, wall_end);
+      _exit(0);
+    }
+
+    children.push_back(pid);
+
+    // The master stays open in the bridge only. The slave can be opened by path, until
+    // then the frames are dropped once the pty's buffer is full.
+    if (fd >= 0 && fd != STDOUT_FILENO) close(fd);
+  }
+
+  fprintf(stderr, "fleet: %zu bridges running\n", children.size());
+
+  uint64_t last_frames = 0;
+  int64_t next_report = wall_start + k_report_interval;
+
+  while (next_report < wall_end) {
+    sleep_until(next_report);
+    report("", stats, config.bridges, k_report_interval / 1e9, last_frames);
+    last_frames = total_frames(stats, config.bridges);
+    next_report += k_report_interval;
+  }
+
+  int failed = 0;
+  for (pid_t pid : children) {
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status)) ++failed;
+  }
+
+  if (failed) fprintf(stderr, "fleet: %d bridges failed\n", failed);
+
+  report("total", stats, config.bridges, config.seconds, 0);
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+// ------------------------------------------------------------------------------------------------
+// Replays a recorded sensor trace through the bridge on the host.
+//
+// The unmodified davis6410 and tx20emulator classes run on the simulated Arduino. The
+// trace drives the anemometer, vane and Dtr inputs, and the frames written to Txd are
+// decoded and printed one per line so the output of two firmware versions can be diffed.
+//
+//    replay <trace> [loop_us]
+//
+// loop_us is the virtual time each pass of the main loop takes, the default is 1000.
+// Each output line is,
+//    <time s> <direction> <direction name> <speed 0.1 m/s> <ok|bad>
+// ------------------------------------------------------------------------------------------------
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "davis6410.h"
+#include "pins.h"
+#include "sensortracereader.h"
+#include "sim.h"
+#include "tx20decoder.h"
+#include "tx20emulator.h"
+
+// How long to keep running after the last record, enough to finish the frame in progress.
+constexpr uint64_t k_run_out = 3000000;
+
+// The replay state shared with the callbacks.
+struct replay {
+  sensortracereader reader;
+  sensortracerecord record;
+  bool done = false;
+};
+
+// ------------------------------------------------------------------------------------------------
+// Apply the current trace record to the simulated inputs and queue the next one.
+// ------------------------------------------------------------------------------------------------
+static void apply_record(void* context) {
+  replay* self = static_cast<replay*>(context);
+
+  switch (self->record.type) {
+    case sensortracetype::pulse: {
+        sim_set_pin(k_wind_sensor_pin, HIGH);
+        sim_set_pin(k_wind_sensor_pin, LOW);
+        break;
+      }
+
+    case sensortracetype::vane: {
+        sim_set_analog(k_wind_direction_pin, self->record.value);
+        break;
+      }
+
+    case sensortracetype::dtr_low: {
+        sim_set_pin(k_dtr_pin, LOW);
+        break;
+      }
+
+    case sensortracetype::dtr_high: {
+        sim_set_pin(k_dtr_pin, HIGH);
+        break;
+      }
+  }
+
+  if (self->reader.next(self->record))
+    sim_set_next_input(self->record.t);
+  else
+    self->done = true;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Print a decoded frame.
+// ------------------------------------------------------------------------------------------------
+static void print_frame(void*, const tx20frame& frame) {
+  printf("%.6f %d %s %d %s\n", frame.t / 1e6, frame.direction, winddrn_to_string(frame.direction),
+         frame.speed, frame.errors ? "bad" : "ok");
+}
+
+// ------------------------------------------------------------------------------------------------
+// Pass the Txd writes to the decoder.
+// ------------------------------------------------------------------------------------------------
+static void watch_txd(void* context, uint64_t t, bool level) {
+  static_cast<tx20decoder*>(context)->edge(t, level);
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: replay <trace> [loop_us]\n");
+    return 2;
+  }
+
+  const uint64_t loop_us = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1000;
+
+  sim_reset();
+
+  replay session;
+  if (!session.reader.open(argv[1])) {
+    fprintf(stderr, "replay: %s is not a sensor trace\n", argv[1]);
+    return 1;
+  }
+
+  tx20decoder decoder(print_frame, nullptr);
+  sim_watch_pin(k_txd_pin, watch_txd, &decoder);
+
+  davis6410 wind_meter(k_wind_sensor_pin, k_wind_direction_pin);
+  tx20emulator tx20_emulator(k_dtr_pin, k_txd_pin);
+
+  // The wind meter is set up as in main.cpp.
+  wind_meter.initialise();
+  wind_meter.set_direction_mode(davis6410direction::run_weighted);
+  wind_meter.set_speed_mode(davis6410speed::interpolated);
+  tx20_emulator.initialise(&wind_meter);
+
+  if (session.reader.next(session.record))
+    sim_set_input(apply_record, &session, session.record.t);
+  else
+    session.done = true;
+
+  const auto wall_start = std::chrono::steady_clock::now();
+
+  uint64_t end_t = 0;
+  while (!session.done || sim_time() < end_t) {
+    wind_meter.service();
+    tx20_emulator.service();
+
+    sim_advance_to(sim_time() + loop_us);
+
+    if (!session.done) end_t = sim_time() + k_run_out;
+  }
+
+  decoder.flush(sim_time());
+
+  const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+  const double virtual_s = sim_time() / 1e6;
+
+  fprintf(stderr, "replay: %u frames, %u bad, %.1f virtual s in %.3f s (%.0fx real time)\n",
+          decoder.frames(), decoder.bad_frames(), virtual_s, wall, wall > 0 ? virtual_s / wall : 0.0);
+
+  return 0;
+}
@@ -0,0 +1,141 @@
+// ------------------------------------------------------------------------------------------------
+// A simulated Arduino core for running the bridge code on the host.
+//
+// Only the parts of the Arduino api used by the bridge classes are provided. Time is
+// virtual and is controlled by the simulator, see sim.h. The types match those on the
+// AVR, eg micros() and millis() return 32 bit values that wrap just like the real ones.
+// ------------------------------------------------------------------------------------------------
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+#include "avr/pgmspace.h"
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define DEC 10
+#define HEX 16
+
+#define LED_BUILTIN 13
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define A6 20
+#define A7 21
+
+#define NOT_AN_INTERRUPT -1
+#define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : NOT_AN_INTERRUPT))
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper*>(string_literal))
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+
+void attachInterrupt(uint8_t interrupt, void (*fn)(), int mode);
+void detachInterrupt(uint8_t interrupt);
+
+void sei();
+void cli();
+#define interrupts() sei()
+#define noInterrupts() cli()
+
+// Stand ins for the AVR timers that the bridge programs through their registers. They run
+// from the virtual clock, see sim.h, and are only declared on the host.
+//    timer1 - a 16 bit counter that counts microseconds, and a one shot compare that calls
+//             fn when the counter next reaches t, like the timer 1 compare A interrupt
+//    timer2 - calls fn every period microseconds, like the timer 2 compare interrupt
+uint16_t timer1_count();
+void timer1_set_compare(uint16_t t, void (*fn)());
+void timer1_stop();
+void timer2_start(uint32_t period_us, void (*fn)());
+
+// A cut down version of the Arduino String class.
+class String {
+public:
+  String(const char* s = "") : s_(s) {}
+  String(const __FlashStringHelper* s) : s_(reinterpret_cast<const char*>(s)) {}
+  String(char c) : s_(1, c) {}
+  String(unsigned char n, int base = DEC) : String(static_cast<unsigned long>(n), base) {}
+  String(int n, int base = DEC) : String(static_cast<long>(n), base) {}
+  String(unsigned int n, int base = DEC) : String(static_cast<unsigned long>(n), base) {}
+  String(long n, int base = DEC);
+  String(unsigned long n, int base = DEC);
+  String(float n, int digits = 2) : String(static_cast<double>(n), digits) {}
+  String(double n, int digits = 2);
+
+  const char* c_str() const { return s_.c_str(); }
+  unsigned int length() const { return s_.length(); }
+
+  String& operator+=(const String& rhs) { s_ += rhs.s_; return *this; }
+  friend String operator+(String lhs, const String& rhs) { return lhs += rhs; }
+
+private:
+  std::string s_;
+};
+
+// A cut down version of the Arduino Print class.
+class Print {
+public:
+  virtual ~Print() {}
+
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size);
+
+  size_t print(const __FlashStringHelper* s);
+  size_t print(const char* s);
+  size_t print(const String& s) { return print(s.c_str()); }
+  size_t print(char c);
+  size_t print(unsigned char n, int base = DEC) { return print(static_cast<unsigned long>(n), base); }
+  size_t print(int n, int base = DEC) { return print(static_cast<long>(n), base); }
+  size_t print(unsigned int n, int base = DEC) { return print(static_cast<unsigned long>(n), base); }
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(double n, int digits = 2);
+
+  template <typename T>
+  size_t println(T value) { size_t n = print(value); return n + println(); }
+
+  template <typename T>
+  size_t println(T value, int format) { size_t n = print(value, format); return n + println(); }
+
+  size_t println() { return print("\r\n"); }
+};
+
+// The serial port writes to stdout and never has anything to read.
+class HardwareSerial : public Print {
+public:
+  void begin(unsigned long) {}
+  int available() { return 0; }
+  int read() { return -1; }
+
+  size_t write(uint8_t c) override;
+  using Print::write;
+};
+
+extern HardwareSerial Serial;
@@ -0,0 +1,24 @@
+// ------------------------------------------------------------------------------------------------
+// Simulated avr-libc EEPROM access.
+//
+// The EEPROM is 1KB like the ATmega328 and starts off erased. Writes complete instantly.
+// ------------------------------------------------------------------------------------------------
+#pragma once
+
+#include <stdint.h>
+
+constexpr int k_sim_eeprom_size = 1024;
+
+extern uint8_t sim_eeprom[k_sim_eeprom_size];
+
+inline bool eeprom_is_ready() {
+  return true;
+}
+
+inline uint8_t eeprom_read_byte(const uint8_t* address) {
+  return sim_eeprom[reinterpret_cast<uintptr_t>(address) % k_sim_eeprom_size];
+}
+
+inline void eeprom_update_byte(uint8_t* address, uint8_t value) {
+  sim_eeprom[reinterpret_cast<uintptr_t>(address) % k_sim_eeprom_size] = value;
+}
@@ -0,0 +1,17 @@
+// ------------------------------------------------------------------------------------------------
+// Simulated avr-libc program memory access.
+//
+// On the host there is only the one address space, so flash reads are plain reads.
+// ------------------------------------------------------------------------------------------------
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+
+#define pgm_read_byte(address) (*reinterpret_cast<const uint8_t*>(address))
+#define pgm_read_word(address) (*reinterpret_cast<const uint16_t*>(address))
+#define pgm_read_dword(address) (*reinterpret_cast<const uint32_t*>(address))
+
+#define memcpy_P memcpy
@@ -0,0 +1,378 @@
+// ------------------------------------------------------------------------------------------------
+// The simulated Arduino core.
+// ------------------------------------------------------------------------------------------------
+#include "sim.h"
+
+#include <stdio.h>
+
+#include "Arduino.h"
+#include "avr/eeprom.h"
+
+HardwareSerial Serial;
+
+// Where the serial port output goes, nowhere if null.
+static FILE* serial_output = stdout;
+
+uint8_t sim_eeprom[k_sim_eeprom_size];
+
+// The virtual clock in microseconds.
+static uint64_t sim_t = 0;
+
+// Set while inputs are being applied, isrs run in zero time so the clock is frozen.
+static bool sim_in_input = false;
+
+// The input source.
+static siminputfn input_fn = nullptr;
+static void* input_context = nullptr;
+static bool input_pending = false;
+static uint64_t input_t = 0;
+
+// Timer 2.
+static simtimerfn timer_fn = nullptr;
+static uint64_t timer_period = 0;
+static uint64_t timer_next_t = 0;
+
+// The timer 1 compare, a one shot alarm.
+static simtimerfn alarm_fn = nullptr;
+static uint64_t alarm_t = 0;
+
+// The state of the digital and analog pins.
+static bool pin_level[k_sim_pin_count];
+static bool pin_output[k_sim_pin_count];
+static int pin_analog[k_sim_pin_count];
+
+// Watchers for the output pins.
+static simwatchfn watch_fn[k_sim_pin_count];
+static void* watch_context[k_sim_pin_count];
+
+// The two external interrupts, on pins 2 and 3.
+static void (*isr_fn[2])() = { nullptr, nullptr };
+static int isr_mode[2];
+static bool isr_enabled = true;
+
+// ------------------------------------------------------------------------------------------------
+// Reset the simulator.
+// ------------------------------------------------------------------------------------------------
+void sim_reset(uint64_t t) {
+  sim_t = t;
+  sim_in_input = false;
+
+  input_fn = nullptr;
+  input_pending = false;
+
+  timer_fn = nullptr;
+  alarm_fn = nullptr;
+
+  for (int i = 0; i < k_sim_pin_count; ++i) {
+    pin_level[i] = true;
+    pin_output[i] = false;
+    pin_analog[i] = 0;
+    watch_fn[i] = nullptr;
+  }
+
+  isr_fn[0] = isr_fn[1] = nullptr;
+  isr_enabled = true;
+
+  memset(sim_eeprom, 0xff, sizeof(sim_eeprom));
+}
+
+// ------------------------------------------------------------------------------------------------
+// Return the virtual time.
+// ------------------------------------------------------------------------------------------------
+uint64_t sim_time() {
+  return sim_t;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Advance the virtual clock, applying inputs, timer ticks and the alarm at their exact times.
+// Anything that reads the time from inside one of these (ie an isr) does not move the clock.
+// ------------------------------------------------------------------------------------------------
+void sim_advance_to(uint64_t t) {
+  if (sim_in_input) return;
+
+  enum class source { none, input, timer, alarm };
+
+  for (;;) {
+    // Find the earliest event due by t, an input goes first if they are at the same time.
+    source next = source::none;
+    uint64_t due = t;
+
+    if (input_pending && input_t <= due) {
+      next = source::input;
+      due = input_t;
+    }
+
+    if (timer_fn && timer_next_t <= due && (next == source::none || timer_next_t < due)) {
+      next = source::timer;
+      due = timer_next_t;
+    }
+
+    if (alarm_fn && alarm_t <= due && (next == source::none || alarm_t < due)) {
+      next = source::alarm;
+      due = alarm_t;
+    }
+
+    if (next == source::none) break;
+
+    sim_in_input = true;
+    if (due > sim_t) sim_t = due;
+
+    switch (next) {
+      case source::input: {
+          input_pending = false;
+          input_fn(input_context);
+          break;
+        }
+
+      case source::timer: {
+          timer_next_t += timer_period;
+          timer_fn();
+          break;
+        }
+
+      case source::alarm: {
+          // The alarm is one shot, the callback may set it again.
+          simtimerfn fn = alarm_fn;
+          alarm_fn = nullptr;
+          fn();
+          break;
+        }
+
+      case source::none:
+        break;
+    }
+
+    sim_in_input = false;
+  }
+
+  if (t > sim_t) sim_t = t;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Start timer 2.
+// ------------------------------------------------------------------------------------------------
+void timer2_start(uint32_t period_us, void (*fn)()) {
+  timer_fn = fn;
+  timer_period = period_us;
+  timer_next_t = sim_t + period_us;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Timer 1, the counter is the low 16 bits of the clock and the compare is a one shot alarm.
+// ------------------------------------------------------------------------------------------------
+uint16_t timer1_count() {
+  return static_cast<uint16_t>(sim_t);
+}
+
+void timer1_set_compare(uint16_t t, void (*fn)()) {
+  // The compare matches when the counter next reaches t, a full period on if it is there now.
+  const uint16_t ahead = t - timer1_count();
+
+  alarm_t = sim_t + (ahead ? ahead : 0x10000);
+  alarm_fn = fn;
+}
+
+void timer1_stop() {
+  alarm_fn = nullptr;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Set the input source.
+// ------------------------------------------------------------------------------------------------
+void sim_set_input(siminputfn fn, void* context, uint64_t t) {
+  input_fn = fn;
+  input_context = context;
+  sim_set_next_input(t);
+}
+
+void sim_set_next_input(uint64_t t) {
+  input_t = t;
+  input_pending = input_fn != nullptr;
+}
+
+void sim_clear_next_input() {
+  input_pending = false;
+}
+
+bool sim_input_pending() {
+  return input_pending;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Drive an input pin and run any isr attached to it.
+// ------------------------------------------------------------------------------------------------
+void sim_set_pin(uint8_t pin, bool level) {
+  if (pin >= k_sim_pin_count || pin_level[pin] == level) return;
+
+  pin_level[pin] = level;
+
+  const int interrupt = digitalPinToInterrupt(pin);
+  if (interrupt == NOT_AN_INTERRUPT || !isr_fn[interrupt] || !isr_enabled) return;
+
+  const int mode = isr_mode[interrupt];
+  if (mode == CHANGE || (mode == FALLING && !level) || (mode == RISING && level)) {
+    // Isrs run with interrupts disabled, just like on the AVR.
+    isr_enabled = false;
+    isr_fn[interrupt]();
+    isr_enabled = true;
+  }
+}
+
+void sim_set_analog(uint8_t pin, int value) {
+  if (pin < k_sim_pin_count) pin_analog[pin] = value;
+}
+
+void sim_watch_pin(uint8_t pin, simwatchfn fn, void* context) {
+  if (pin >= k_sim_pin_count) return;
+
+  watch_fn[pin] = fn;
+  watch_context[pin] = context;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Send the serial port output to a file.
+// ------------------------------------------------------------------------------------------------
+void sim_set_serial_output(FILE* out) {
+  serial_output = out;
+}
+
+// ------------------------------------------------------------------------------------------------
+// The Arduino time functions.
+// ------------------------------------------------------------------------------------------------
+uint32_t micros() {
+  sim_advance_to(sim_t + k_sim_call_cost);
+  return static_cast<uint32_t>(sim_t);
+}
+
+uint32_t millis() {
+  sim_advance_to(sim_t + k_sim_call_cost);
+  return static_cast<uint32_t>(sim_t / 1000);
+}
+
+void delay(uint32_t ms) {
+  sim_advance_to(sim_t + ms * 1000ull);
+}
+
+void delayMicroseconds(unsigned int us) {
+  sim_advance_to(sim_t + us);
+}
+
+// ------------------------------------------------------------------------------------------------
+// The Arduino io functions.
+// ------------------------------------------------------------------------------------------------
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin >= k_sim_pin_count) return;
+
+  pin_output[pin] = mode == OUTPUT;
+  if (mode == INPUT_PULLUP) pin_level[pin] = true;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin >= k_sim_pin_count) return;
+
+  pin_level[pin] = value != LOW;
+  if (watch_fn[pin]) watch_fn[pin](watch_context[pin], sim_t, pin_level[pin]);
+}
+
+int digitalRead(uint8_t pin) {
+  return pin < k_sim_pin_count && pin_level[pin] ? HIGH : LOW;
+}
+
+int analogRead(uint8_t pin) {
+  // Analog pins can be given as channel numbers or pin numbers.
+  if (pin < A0) pin += A0;
+
+  sim_advance_to(sim_t + k_sim_adc_cost);
+  return pin < k_sim_pin_count ? pin_analog[pin] : 0;
+}
+
+void attachInterrupt(uint8_t interrupt, void (*fn)(), int mode) {
+  if (interrupt > 1) return;
+
+  isr_fn[interrupt] = fn;
+  isr_mode[interrupt] = mode;
+}
+
+void detachInterrupt(uint8_t interrupt) {
+  if (interrupt <= 1) isr_fn[interrupt] = nullptr;
+}
+
+void sei() {
+  isr_enabled = true;
+}
+
+void cli() {
+  isr_enabled = false;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Print.
+// ------------------------------------------------------------------------------------------------
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  for (size_t i = 0; i < size; ++i) write(buffer[i]);
+  return size;
+}
+
+size_t Print::print(const __FlashStringHelper* s) {
+  return print(reinterpret_cast<const char*>(s));
+}
+
+size_t Print::print(const char* s) {
+  return write(reinterpret_cast<const uint8_t*>(s), strlen(s));
+}
+
+size_t Print::print(char c) {
+  return write(static_cast<uint8_t>(c));
+}
+
+size_t Print::print(long n, int base) {
+  if (n < 0 && base == DEC) return print('-') + print(static_cast<unsigned long>(-n), base);
+  return print(static_cast<unsigned long>(n), base);
+}
+
+size_t Print::print(unsigned long n, int base) {
+  char buf[8 * sizeof(long) + 1];
+  char* s = &buf[sizeof(buf) - 1];
+  *s = '\0';
+
+  do {
+    const int digit = n % base;
+    *--s = static_cast<char>(digit < 10 ? '0' + digit : 'A' + digit - 10);
+    n /= base;
+  } while (n);
+
+  return print(s);
+}
+
+size_t Print::print(double n, int digits) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  return print(buf);
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  if (!serial_output) return 1;
+  return fputc(c, serial_output) == EOF ? 0 : 1;
+}
+
+// ------------------------------------------------------------------------------------------------
+// String.
+// ------------------------------------------------------------------------------------------------
+String::String(long n, int base) {
+  if (n < 0 && base == DEC) s_ = "-" + String(static_cast<unsigned long>(-n), base).s_;
+  else *this = String(static_cast<unsigned long>(n), base);
+}
+
+String::String(unsigned long n, int base) {
+  do {
+    const int digit = n % base;
+    s_.insert(s_.begin(), static_cast<char>(digit < 10 ? '0' + digit : 'A' + digit - 10));
+    n /= base;
+  } while (n);
+}
+
+String::String(double n, int digits) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  s_ = buf;
+}
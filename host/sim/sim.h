@@ -0,0 +1,71 @@
+// ------------------------------------------------------------------------------------------------
+// Control of the simulated Arduino.
+//
+// The simulator keeps a 64 bit virtual clock in microseconds. micros() and millis()
+// return the low 32 bits of it, so they wrap exactly as they do on the AVR. Reading the
+// time costs k_sim_call_cost microseconds of virtual time, which lets busy wait loops
+// make progress.
+//
+// Inputs are fed in by a single input source. The simulator calls it whenever the clock
+// reaches the time of the next input, and isrs attached to the pins run at that exact
+// virtual time. The timer stand ins declared in Arduino.h are run the same way.
+// Outputs can be watched by attaching a callback to a pin, and the serial port output
+// can be redirected.
+// ------------------------------------------------------------------------------------------------
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+// The number of simulated digital pins, including the analog ones.
+constexpr int k_sim_pin_count = 22;
+
+// Virtual time taken by each call to micros() or millis().
+// This matches the resolution of micros() on an 8MHz Pro Mini.
+constexpr uint64_t k_sim_call_cost = 8;
+
+// Virtual time taken by an analogRead().
+constexpr uint64_t k_sim_adc_cost = 104;
+
+// Called when the virtual clock reaches the time of the next input.
+// It should apply the input and then set the time of the one after.
+using siminputfn = void (*)(void* context);
+
+// Called by a simulated hardware timer, like a timer compare isr.
+using simtimerfn = void (*)();
+
+// Called when a watched output pin is written.
+using simwatchfn = void (*)(void* context, uint64_t t, bool level);
+
+// Reset the simulator, all pins float high and the clock is set to t.
+void sim_reset(uint64_t t = 0);
+
+// Return the virtual time in microseconds.
+uint64_t sim_time();
+
+// Advance the virtual clock to t, applying any inputs that fall due on the way.
+void sim_advance_to(uint64_t t);
+
+// Set the input source and the time of its first input.
+void sim_set_input(siminputfn fn, void* context, uint64_t t);
+
+// Set the time of the next input, or clear it if there are none left.
+void sim_set_next_input(uint64_t t);
+void sim_clear_next_input();
+
+// Return true if there is an input pending.
+bool sim_input_pending();
+
+// Drive an input pin to a level.
+// An isr attached to the pin runs if the change matches its mode.
+void sim_set_pin(uint8_t pin, bool level);
+
+// Set the value an analog pin reads as.
+void sim_set_analog(uint8_t pin, int value);
+
+// Watch writes to an output pin.
+void sim_watch_pin(uint8_t pin, simwatchfn fn, void* context);
+
+// Send the serial port output to a file, or discard it if out is null.
+// The default is stdout.
+void sim_set_serial_output(FILE* out);
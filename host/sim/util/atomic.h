@@ -0,0 +1,12 @@
+// ------------------------------------------------------------------------------------------------
+// Simulated avr-libc atomic blocks.
+//
+// The simulator only runs isrs from inside the time functions, so a block of code that
+// does not read the time is already atomic.
+// ------------------------------------------------------------------------------------------------
+#pragma once
+
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON 0
+
+#define ATOMIC_BLOCK(type) for (int atomic_once_ = 1; atomic_once_; atomic_once_ = 0)
@@ -0,0 +1,329 @@
+// ------------------------------------------------------------------------------------------------
+// A long duration soak test of the bridge on the host.
+//
+// The unmodified sketch, ie main.cpp with its setup() and loop(), runs on the simulated
+// Arduino through weeks or months of virtual time. A synthetic station drives it with
+// phases of polling, Dtr low and a steady wind, and phases of being idle, Dtr released and
+// calm. While idle the main loop is run far less often so that the virtual clock jumps
+// across the quiet periods.
+//
+//    soak [days] [start] [seed]
+//
+// days is the length of the run, the default is 60 which crosses the millis() wrap.
+// start is the virtual time in microseconds the clock starts at, or one of micros or millis
+// to start shortly before that clock wraps. The default is 0.
+// seed picks the sequence of phases, the default is 1.
+//
+// Throughout the run it checks,
+//    cadence - frames within a polling phase are k_frame_interval apart
+//    frames - every frame decodes and its speed matches the wind
+//    window - every completed sample window lasts k_wind_speed_sample_t
+//    led - the front panel led never stays on or off for too long
+// Each failure is printed with the time and the values of micros() and millis(). The exit
+// status is 1 if there were any failures.
+// ------------------------------------------------------------------------------------------------
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "davis6410.h"
+#include "pins.h"
+#include "sim.h"
+#include "tx20decoder.h"
+#include "tx20emulator.h"
+
+// The sketch in main.cpp.
+void setup();
+void loop();
+
+extern davis6410 wind_meter;
+extern tx20emulator tx20_emulator;
+
+// The virtual times at which micros() and millis() wrap.
+constexpr uint64_t k_micros_wrap = 1ull << 32;
+constexpr uint64_t k_millis_wrap = (1ull << 32) * 1000;
+
+// A named start is this long before the wrap.
+constexpr uint64_t k_wrap_lead = 600ull * 1000000;
+
+// The virtual time each pass of the main loop takes while polling and while idle.
+constexpr uint64_t k_loop_us = 1000;
+constexpr uint64_t k_idle_loop_us = 100000;
+
+// The range of lengths of the polling and idle phases, in seconds.
+constexpr uint32_t k_active_min_s = 5 * 60;
+constexpr uint32_t k_active_max_s = 60 * 60;
+constexpr uint32_t k_idle_min_s = 10 * 60;
+constexpr uint32_t k_idle_max_s = 12 * 60 * 60;
+
+// The wind speed while polling is up to this many mph, and the vane reading is kept
+// clear of the rails and the dead band.
+constexpr uint32_t k_max_mph = 40;
+constexpr uint32_t k_min_vane = 100;
+constexpr uint32_t k_max_vane = 900;
+
+// The frame interval and how far a frame may stray from it.
+constexpr uint64_t k_frame_interval = 2500000;
+constexpr uint64_t k_cadence_tolerance = 2 * k_loop_us;
+
+// A sample window may end late by up to a loop pass plus this.
+constexpr uint64_t k_window_tolerance = 2000;
+
+// The longest the led may stay on, a sample flash over a long pattern blink, and the
+// longest it may stay off, the gap in the slowest pattern.
+constexpr uint64_t k_led_max_on = 600000;
+constexpr uint64_t k_led_max_off = 2100000;
+
+// Stop printing failures after this many.
+constexpr uint32_t k_max_reported = 20;
+
+// The soak state shared with the callbacks.
+struct soak {
+  uint64_t rng = 1;
+
+  // The current phase.
+  bool active = false;
+  uint32_t phase = 0;
+  uint64_t phase_start_t = 0;
+  uint64_t phase_end_t = 0;
+  uint32_t mph = 0;
+  uint64_t pulse_interval = 0;
+  uint64_t next_pulse_t = 0;
+
+  // The last frame.
+  bool have_frame = false;
+  uint32_t frame_phase = 0;
+  uint64_t frame_t = 0;
+
+  // The sample window in progress.
+  davis6410state wind_state = davis6410state::idle;
+  uint64_t window_t = 0;
+  uint64_t window_step = 0;
+
+  // The front panel led.
+  bool led_level = false;
+  uint64_t led_t = 0;
+
+  // Statistics.
+  uint32_t frames = 0;
+  uint32_t windows = 0;
+  uint32_t failures = 0;
+};
+
+// ------------------------------------------------------------------------------------------------
+// Return a pseudo random number in the range lo to hi.
+// ------------------------------------------------------------------------------------------------
+static uint32_t random_range(soak* self, uint32_t lo, uint32_t hi) {
+  // xorshift64
+  self->rng ^= self->rng << 13;
+  self->rng ^= self->rng >> 7;
+  self->rng ^= self->rng << 17;
+
+  return lo + static_cast<uint32_t>(self->rng % (hi - lo + 1));
+}
+
+// ------------------------------------------------------------------------------------------------
+// Record a failure.
+// ------------------------------------------------------------------------------------------------
+static void fail(soak* self, uint64_t t, const char* what, long long value) {
+  if (++self->failures > k_max_reported) return;
+
+  printf("FAIL %.6f micros=%u millis=%u %s %lld\n", t / 1e6, static_cast<uint32_t>(t),
+         static_cast<uint32_t>(t / 1000), what, value);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Start the next phase, alternating between polling and idle.
+// ------------------------------------------------------------------------------------------------
+static void next_phase(soak* self, uint64_t t) {
+  self->active = !self->active;
+  ++self->phase;
+  self->phase_start_t = t;
+
+  const uint32_t length_s = self->active ? random_range(self, k_active_min_s, k_active_max_s)
+                                         : random_range(self, k_idle_min_s, k_idle_max_s);
+  self->phase_end_t = t + length_s * 1000000ull;
+
+  // The wind speed in mph is the number of pulses in a sample period.
+  self->mph = self->active ? random_range(self, 0, k_max_mph) : 0;
+  self->pulse_interval = self->mph ? k_wind_speed_sample_t * 1000ull / self->mph : 0;
+  self->next_pulse_t = t + self->pulse_interval;
+
+  sim_set_analog(k_wind_direction_pin, random_range(self, k_min_vane, k_max_vane));
+  sim_set_pin(k_dtr_pin, self->active ? LOW : HIGH);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Apply the input that is due and queue the next one.
+// ------------------------------------------------------------------------------------------------
+static void apply_input(void* context) {
+  soak* self = static_cast<soak*>(context);
+  const uint64_t t = sim_time();
+
+  if (t >= self->phase_end_t) {
+    next_phase(self, t);
+  }
+  else {
+    sim_set_pin(k_wind_sensor_pin, HIGH);
+    sim_set_pin(k_wind_sensor_pin, LOW);
+    self->next_pulse_t += self->pulse_interval;
+  }
+
+  if (self->pulse_interval && self->next_pulse_t < self->phase_end_t)
+    sim_set_next_input(self->next_pulse_t);
+  else
+    sim_set_next_input(self->phase_end_t);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Check a decoded frame.
+// ------------------------------------------------------------------------------------------------
+static void check_frame(void* context, const tx20frame& frame) {
+  soak* self = static_cast<soak*>(context);
+  ++self->frames;
+
+  if (frame.errors) fail(self, frame.t, "bad frame, errors", frame.errors);
+
+  // Frames are decoded once they have finished, so the phase may have moved on. Only frames
+  // sent in the current polling phase are checked against the wind.
+  if (!self->active || frame.t < self->phase_start_t) return;
+
+  // The speed is interpolated from the pulse times, so it is within a revolution either side
+  // of mph even when the wind changes part way through the window.
+  const int lo = mph_to_tx20_units(self->mph ? self->mph - 1 : 0);
+  const int hi = mph_to_tx20_units(self->mph + 1);
+  if (frame.speed < lo || frame.speed > hi) fail(self, frame.t, "speed", frame.speed - lo);
+
+  if (self->have_frame && self->frame_phase == self->phase) {
+    const long long error = static_cast<long long>(frame.t - self->frame_t) - k_frame_interval;
+    if (error < -static_cast<long long>(k_cadence_tolerance) ||
+        error > static_cast<long long>(k_cadence_tolerance))
+      fail(self, frame.t, "cadence error us", error);
+  }
+
+  self->have_frame = true;
+  self->frame_phase = self->phase;
+  self->frame_t = frame.t;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Pass the Txd writes to the decoder.
+// ------------------------------------------------------------------------------------------------
+static void watch_txd(void* context, uint64_t t, bool level) {
+  static_cast<tx20decoder*>(context)->edge(t, level);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Check how long the front panel led stayed in the state it is leaving.
+// ------------------------------------------------------------------------------------------------
+static void watch_led(void* context, uint64_t t, bool level) {
+  soak* self = static_cast<soak*>(context);
+  if (level == self->led_level) return;
+
+  const uint64_t limit = self->led_level ? k_led_max_on : k_led_max_off;
+  if (t - self->led_t > limit) fail(self, t, self->led_level ? "led on us" : "led off us", t - self->led_t);
+
+  self->led_level = level;
+  self->led_t = t;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Follow the sample windows of the wind meter and check the length of each one that
+// completes. A window that is aborted goes back to idle instead.
+// ------------------------------------------------------------------------------------------------
+static void check_window(soak* self, uint64_t step) {
+  const davis6410state state = wind_meter.state();
+  const uint64_t t = sim_time();
+
+  if (state == davis6410state::sampling_speed) {
+    if (self->wind_state != davis6410state::sampling_speed) {
+      self->window_t = t;
+      self->window_step = 0;
+    }
+    if (step > self->window_step) self->window_step = step;
+  }
+  else if (self->wind_state == davis6410state::sampling_speed &&
+           state == davis6410state::sampling_direction) {
+    ++self->windows;
+
+    const uint64_t length = t - self->window_t;
+    const uint64_t period = k_wind_speed_sample_t * 1000;
+    if (length + k_window_tolerance < period || length > period + self->window_step + k_window_tolerance)
+      fail(self, t, "window us", length);
+  }
+
+  self->wind_state = state;
+}
+
+int main(int argc, char* argv[]) {
+  const double days = argc > 1 ? atof(argv[1]) : 60;
+
+  uint64_t start_t = 0;
+  if (argc > 2) {
+    if (!strcmp(argv[2], "micros"))
+      start_t = k_micros_wrap - k_wrap_lead;
+    else if (!strcmp(argv[2], "millis"))
+      start_t = k_millis_wrap - k_wrap_lead;
+    else
+      start_t = strtoull(argv[2], nullptr, 10);
+  }
+
+  soak session;
+  if (argc > 3) session.rng = strtoull(argv[3], nullptr, 10) | 1;
+
+  if (days <= 0) {
+    fprintf(stderr, "usage: soak [days] [start] [seed]\n");
+    return 2;
+  }
+
+  sim_reset(start_t);
+  sim_set_serial_output(nullptr);
+
+  tx20decoder decoder(check_frame, &session);
+  sim_watch_pin(k_txd_pin, watch_txd, &decoder);
+  sim_watch_pin(k_front_panel_led_pin, watch_led, &session);
+  session.led_t = start_t;
+
+  setup();
+
+  // The first phase, polling, starts straight away.
+  sim_set_input(apply_input, &session, start_t);
+
+  const uint64_t end_t = start_t + static_cast<uint64_t>(days * 86400e6);
+  const auto wall_start = std::chrono::steady_clock::now();
+
+  while (sim_time() < end_t) {
+    loop();
+
+    const uint64_t step = session.active ? k_loop_us : k_idle_loop_us;
+    sim_advance_to(sim_time() + step);
+
+    check_window(&session, step);
+
+    // Catch an led that has stopped altogether.
+    const uint64_t limit = session.led_level ? k_led_max_on : k_led_max_off;
+    if (sim_time() - session.led_t > limit) {
+      fail(&session, sim_time(), session.led_level ? "led stuck on us" : "led stuck off us",
+           sim_time() - session.led_t);
+      session.led_t = sim_time();
+    }
+  }
+
+  decoder.flush(sim_time());
+
+  const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+  const double virtual_s = (sim_time() - start_t) / 1e6;
+
+  printf("soak: %.1f days from %llu us, %u phases, %u frames, %u windows, "
+         "micros wrapped %llu times, millis wrapped %llu times, %u failures\n",
+         virtual_s / 86400, static_cast<unsigned long long>(start_t), session.phase, session.frames,
+         session.windows, static_cast<unsigned long long>(sim_time() / k_micros_wrap - start_t / k_micros_wrap),
+         static_cast<unsigned long long>(sim_time() / k_millis_wrap - start_t / k_millis_wrap),
+         session.failures);
+
+  fprintf(stderr, "soak: %.0f virtual s in %.3f s (%.0fx real time)\n",
+          virtual_s, wall, wall > 0 ? virtual_s / wall : 0.0);
+
+  return session.failures ? 1 : 0;
+}
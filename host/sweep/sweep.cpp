@@ -0,0 +1,472 @@
+// ------------------------------------------------------------------------------------------------
+// Sweeps the davis6410 settings over a grid and scores each against a reference sensor.
+//
+// The unmodified davis6410 class samples a recorded sensor trace back to back, as it does
+// while Dtr is held low, once for every combination of settings in the grid. Each sample is
+// compared with the mean of a reference track over the same window, eg a sonic anemometer
+// mounted next to the Davis, and the combinations are printed best first.
+//
+//    sweep [-d debounce] [-p period] [-y hysteresis] [-m modes] [-s speeds] [-j jobs]
+//          [-k top] [-l loop_us] <trace> <reference>
+//
+//    -d  the pulse debounce in ms, the default is k_wind_pulse_debounce
+//    -p  the sample period in ms, the default is k_wind_speed_sample_t
+//    -y  the direction hysteresis in units of 1.5 degrees, the default is
+//        k_wind_direction_hysteresis
+//    -m  the direction modes, instant and/or run_weighted, the default is run_weighted
+//    -s  the speed modes, pulse_count and/or interpolated, the default is interpolated
+//    -j  the number of worker processes, the default is one per core
+//    -k  how many of the best combinations to print, the default is 20
+//    -l  the virtual time each pass of the main loop takes, the default is 1000
+//
+// The numbers are a single value, a list 10,12,18 or a range with a step 10:30:2.
+// The reference is a text file with one "<time s> <mph> <degrees>" line per reading, in
+// time order and with the same time origin as the trace. Lines starting with # are skipped.
+//
+// Each output line is,
+//    <debounce> <period> <hysteresis> <mode> <speed mode> <samples> <speed bias> <speed rms>
+//    <direction rms> <score>
+// The speeds are in mph and the direction is the error of the reported compass sector in
+// degrees, which is only counted when the reference is above k_sweep_min_direction_mph.
+// The score is speed rms + direction rms / 22.5, so a sector off counts the same as 1 mph.
+//
+// The isr state of davis6410 is in file statics, so a process can only run one combination
+// at a time. The workers are processes which take the next combination from a counter in
+// shared memory, and the trace is mapped read only so they all share the one copy.
+// ------------------------------------------------------------------------------------------------
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "davis6410.h"
+#include "pins.h"
+#include "sensortracereader.h"
+#include "sim.h"
+
+// The direction isn't scored while the reference is below this speed, the vane wanders.
+constexpr double k_sweep_min_direction_mph = 2;
+
+// The width of a compass sector in degrees, used to weigh the direction in the score.
+constexpr double k_sweep_sector_degrees = 22.5;
+
+// A combination of settings.
+struct sweepconfig {
+  uint32_t debounce;
+  uint32_t period;
+  uint32_t hysteresis;
+  davis6410direction mode;
+  davis6410speed speed;
+};
+
+// The score of a combination, written by the worker that ran it.
+struct sweepresult {
+  uint32_t samples;
+  uint32_t direction_samples;
+  double speed_error;
+  double speed_sq;
+  double direction_sq;
+
+  double speed_rms() const { return samples ? sqrt(speed_sq / samples) : 0; }
+  double direction_rms() const { return direction_samples ? sqrt(direction_sq / direction_samples) : 0; }
+  double score() const { return speed_rms() + direction_rms() / k_sweep_sector_degrees; }
+};
+
+// The shared memory, the counter the workers take combinations from and the results.
+struct sweepshared {
+  std::atomic<uint32_t> next;
+  sweepresult results[1];
+};
+
+// ------------------------------------------------------------------------------------------------
+// The reference track, with running sums so the mean over a window is quick to find.
+// ------------------------------------------------------------------------------------------------
+class sweepreference {
+
+public:
+
+  // Load the track, returns false if it can't be read or is empty.
+  bool load(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) return false;
+
+    char line[256];
+    double sum_mph = 0, sum_x = 0, sum_y = 0;
+
+    while (fgets(line, sizeof(line), file)) {
+      double t, mph, degrees;
+      if (line[0] == '#' || sscanf(line, "%lf %lf %lf", &t, &mph, &degrees) != 3) continue;
+
+      sum_mph += mph;
+      sum_x += mph * cos(degrees * M_PI / 180);
+      sum_y += mph * sin(degrees * M_PI / 180);
+
+      t_.push_back(static_cast<uint64_t>(t * 1e6));
+      sum_mph_.push_back(sum_mph);
+      sum_x_.push_back(sum_x);
+      sum_y_.push_back(sum_y);
+    }
+
+    fclose(file);
+
+    return !t_.empty();
+  }
+
+  // Return the mean speed over a window and the run weighted direction.
+  // If there are no readings in the window the nearest one after it is used.
+  void mean(uint64_t t0, uint64_t t1, double& mph, double& degrees) const {
+    size_t i = std::lower_bound(t_.begin(), t_.end(), t0) - t_.begin();
+    size_t j = std::upper_bound(t_.begin(), t_.end(), t1) - t_.begin();
+
+    if (i >= t_.size()) i = t_.size() - 1;
+    if (j <= i) j = i + 1;
+
+    const double n = static_cast<double>(j - i);
+    mph = (sum_mph_[j - 1] - (i ? sum_mph_[i - 1] : 0)) / n;
+
+    const double x = sum_x_[j - 1] - (i ? sum_x_[i - 1] : 0);
+    const double y = sum_y_[j - 1] - (i ? sum_y_[i - 1] : 0);
+    degrees = atan2(y, x) * 180 / M_PI;
+  }
+
+private:
+
+  std::vector<uint64_t> t_;
+  std::vector<double> sum_mph_;
+  std::vector<double> sum_x_;
+  std::vector<double> sum_y_;
+};
+
+// The state of a run shared with the callbacks.
+struct sweeprun {
+  sensortracereader reader;
+  sensortracerecord record;
+  bool done = false;
+
+  const sweepreference* reference;
+  davis6410* wind_meter;
+  uint64_t sample_start_t;
+  sweepresult result;
+};
+
+// ------------------------------------------------------------------------------------------------
+// Apply the current trace record to the simulated inputs and queue the next one.
+// The Dtr records are skipped, the wind meter samples all the time.
+// ------------------------------------------------------------------------------------------------
+static void apply_record(void* context) {
+  sweeprun* self = static_cast<sweeprun*>(context);
+
+  if (self->record.type == sensortracetype::pulse) {
+    sim_set_pin(k_wind_sensor_pin, HIGH);
+    sim_set_pin(k_wind_sensor_pin, LOW);
+  }
+  else if (self->record.type == sensortracetype::vane) {
+    sim_set_analog(k_wind_direction_pin, self->record.value);
+  }
+
+  if (self->reader.next(self->record))
+    sim_set_next_input(self->record.t);
+  else
+    self->done = true;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Score a sample against the reference over the same window.
+// ------------------------------------------------------------------------------------------------
+static void score_sample(void* context) {
+  sweeprun* self = static_cast<sweeprun*>(context);
+  sweepresult& result = self->result;
+
+  double mph, degrees;
+  self->reference->mean(self->sample_start_t, sim_time(), mph, degrees);
+
+  const double speed_error = self->wind_meter->get_wind_mph() - mph;
+  result.speed_error += speed_error;
+  result.speed_sq += speed_error * speed_error;
+  ++result.samples;
+
+  if (mph >= k_sweep_min_direction_mph) {
+    double direction_error = self->wind_meter->get_wind_direction() * k_sweep_sector_degrees - degrees;
+    direction_error = fmod(direction_error + 540, 360) - 180;
+
+    result.direction_sq += direction_error * direction_error;
+    ++result.direction_samples;
+  }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Run the trace through the wind meter with a combination of settings.
+// ------------------------------------------------------------------------------------------------
+static sweepresult run_config(const sweepconfig& config, const uint8_t* trace, size_t trace_size,
+                              const sweepreference& reference, uint64_t loop_us) {
+  sim_reset();
+
+  sweeprun run;
+  run.reference = &reference;
+  run.result = sweepresult();
+
+  if (!run.reader.open(trace, trace_size) || !run.reader.next(run.record)) return run.result;
+
+  davis6410 wind_meter(k_wind_sensor_pin, k_wind_direction_pin, config.period);
+  run.wind_meter = &wind_meter;
+
+  wind_meter.initialise();
+  wind_meter.set_direction_mode(config.mode);
+  wind_meter.set_speed_mode(config.speed);
+  wind_meter.set_debounce(config.debounce);
+  wind_meter.set_direction_hysteresis(config.hysteresis);
+
+  sim_set_input(apply_record, &run, run.record.t);
+
+  while (!run.done) {
+    if (wind_meter.state() == davis6410state::idle) {
+      run.sample_start_t = sim_time();
+      wind_meter.start_sample(score_sample, &run);
+    }
+
+    wind_meter.service();
+    sim_advance_to(sim_time() + loop_us);
+  }
+
+  return run.result;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Parse a value, a list of values or a range, returns false if it can't be parsed.
+// ------------------------------------------------------------------------------------------------
+static bool parse_values(const char* text, std::vector<uint32_t>& values) {
+  values.clear();
+
+  unsigned lo, hi, step;
+  if (sscanf(text, "%u:%u:%u", &lo, &hi, &step) == 3) {
+    if (!step || lo > hi) return false;
+    for (unsigned v = lo; v <= hi; v += step) values.push_back(v);
+    return true;
+  }
+
+  std::string list = text;
+  for (size_t start = 0; start <= list.size();) {
+    size_t end = list.find(',', start);
+    if (end == std::string::npos) end = list.size();
+
+    char* tail;
+    const unsigned long v = strtoul(list.c_str() + start, &tail, 10);
+    if (tail != list.c_str() + end) return false;
+
+    values.push_back(v);
+    start = end + 1;
+  }
+
+  return !values.empty();
+}
+
+static bool parse_modes(const char* text, std::vector<davis6410direction>& modes) {
+  modes.clear();
+
+  std::string list = text;
+  for (size_t start = 0; start <= list.size();) {
+    size_t end = list.find(',', start);
+    if (end == std::string::npos) end = list.size();
+
+    const std::string mode = list.substr(start, end - start);
+    if (mode == "instant") modes.push_back(davis6410direction::instant);
+    else if (mode == "run_weighted") modes.push_back(davis6410direction::run_weighted);
+    else return false;
+
+    start = end + 1;
+  }
+
+  return !modes.empty();
+}
+
+static bool parse_speeds(const char* text, std::vector<davis6410speed>& speeds) {
+  speeds.clear();
+
+  std::string list = text;
+  for (size_t start = 0; start <= list.size();) {
+    size_t end = list.find(',', start);
+    if (end == std::string::npos) end = list.size();
+
+    const std::string speed = list.substr(start, end - start);
+    if (speed == "pulse_count") speeds.push_back(davis6410speed::pulse_count);
+    else if (speed == "interpolated") speeds.push_back(davis6410speed::interpolated);
+    else return false;
+
+    start = end + 1;
+  }
+
+  return !speeds.empty();
+}
+
+int main(int argc, char* argv[]) {
+  std::vector<uint32_t> debounces = { k_wind_pulse_debounce };
+  std::vector<uint32_t> periods = { k_wind_speed_sample_t };
+  std::vector<uint32_t> hystereses = { k_wind_direction_hysteresis };
+  std::vector<davis6410direction> modes = { davis6410direction::run_weighted };
+  std::vector<davis6410speed> speeds = { davis6410speed::interpolated };
+  long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t top = 20;
+  uint64_t loop_us = 1000;
+  bool usage = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "d:p:y:m:s:j:k:l:")) != -1) {
+    switch (opt) {
+      case 'd': usage |= !parse_values(optarg, debounces); break;
+      case 'p': usage |= !parse_values(optarg, periods); break;
+      case 'y': usage |= !parse_values(optarg, hystereses); break;
+      case 'm': usage |= !parse_modes(optarg, modes); break;
+      case 's': usage |= !parse_speeds(optarg, speeds); break;
+      case 'j': jobs = atol(optarg); break;
+      case 'k': top = strtoul(optarg, nullptr, 10); break;
+      case 'l': loop_us = strtoull(optarg, nullptr, 10); break;
+      default: usage = true; break;
+    }
+  }
+
+  if (usage || argc - optind != 2 || jobs < 1 || !loop_us) {
+    fprintf(stderr, "usage: sweep [-d debounce] [-p period] [-y hysteresis] [-m modes] [-s speeds] "
+                    "[-j jobs] [-k top] [-l loop_us] <trace> <reference>\n");
+    return 2;
+  }
+
+  // The settings are bytes or have to fit the pulse counter.
+  for (uint32_t v : debounces) {
+    if (v > 0xff) {
+      fprintf(stderr, "sweep: the debounce must be at most 255 ms\n");
+      return 2;
+    }
+  }
+
+  for (uint32_t v : hystereses) {
+    if (v > 0xff) {
+      fprintf(stderr, "sweep: the hysteresis must be at most 255\n");
+      return 2;
+    }
+  }
+
+  for (uint32_t v : periods) {
+    if (!v) {
+      fprintf(stderr, "sweep: the period must be at least 1 ms\n");
+      return 2;
+    }
+  }
+
+  const char* trace_path = argv[optind];
+  const char* reference_path = argv[optind + 1];
+
+  // The trace is mapped read only, the workers share the pages.
+  const int fd = open(trace_path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+    fprintf(stderr, "sweep: can't read %s\n", trace_path);
+    return 1;
+  }
+
+  void* trace = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (trace == MAP_FAILED) {
+    perror("sweep: mmap");
+    return 1;
+  }
+
+  sensortracereader check;
+  if (!check.open(static_cast<const uint8_t*>(trace), st.st_size)) {
+    fprintf(stderr, "sweep: %s is not a sensor trace\n", trace_path);
+    return 1;
+  }
+
+  sweepreference reference;
+  if (!reference.load(reference_path)) {
+    fprintf(stderr, "sweep: %s is not a reference track\n", reference_path);
+    return 1;
+  }
+
+  std::vector<sweepconfig> configs;
+  for (uint32_t debounce : debounces)
+    for (uint32_t period : periods)
+      for (uint32_t hysteresis : hystereses)
+        for (davis6410direction mode : modes)
+          for (davis6410speed speed : speeds) configs.push_back({ debounce, period, hysteresis, mode, speed });
+
+  const size_t shared_size = sizeof(sweepshared) + configs.size() * sizeof(sweepresult);
+  void* memory = mmap(nullptr, shared_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    perror("sweep: mmap");
+    return 1;
+  }
+
+  sweepshared* shared = new (memory) sweepshared();
+  shared->next = 0;
+
+  if (jobs > static_cast<long>(configs.size())) jobs = configs.size();
+
+  const auto wall_start = std::chrono::steady_clock::now();
+
+  std::vector<pid_t> workers;
+  for (long i = 0; i < jobs; ++i) {
+    const pid_t pid = fork();
+    if (pid < 0) {
+      perror("sweep: fork");
+      break;
+    }
+
+    if (pid == 0) {
+      for (uint32_t n; (n = shared->next++) < configs.size();)
+        shared->results[n] = run_config(configs[n], static_cast<const uint8_t*>(trace), st.st_size,
+                                        reference, loop_us);
+      _exit(0);
+    }
+
+    workers.push_back(pid);
+  }
+
+  int failed = workers.empty() ? 1 : 0;
+  for (pid_t pid : workers) {
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status)) ++failed;
+  }
+
+  if (failed) {
+    fprintf(stderr, "sweep: %d workers failed\n", failed);
+    return 1;
+  }
+
+  const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+
+  std::vector<size_t> order(configs.size());
+  for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return shared->results[a].score() < shared->results[b].score();
+    });
+
+  if (top > order.size()) top = order.size();
+
+  for (size_t i = 0; i < top; ++i) {
+    const sweepconfig& config = configs[order[i]];
+    const sweepresult& result = shared->results[order[i]];
+
+    printf("%u %u %u %s %s %u %.3f %.3f %.2f %.3f\n", config.debounce, config.period, config.hysteresis,
+           config.mode == davis6410direction::instant ? "instant" : "run_weighted",
+           config.speed == davis6410speed::pulse_count ? "pulse_count" : "interpolated", result.samples,
+           result.samples ? result.speed_error / result.samples : 0, result.speed_rms(),
+           result.direction_rms(), result.score());
+  }
+
+  fprintf(stderr, "sweep: %zu combinations with %zu workers in %.3f s (%.1f per s)\n",
+          configs.size(), workers.size(), wall, wall > 0 ? configs.size() / wall : 0.0);
+
+  return 0;
+}
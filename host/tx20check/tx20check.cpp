@@ -0,0 +1,318 @@
+// ------------------------------------------------------------------------------------------------
+// TX20 bitstream decoder and timing tolerance tester.
+//
+//    tx20check decode <csv> [bit_us]
+//        Decode the frames in a Txd timeline exported from a logic analyser. Each line of
+//        the csv is "<time s>,<level>", lines that don't parse (eg headers) are skipped.
+//
+//    tx20check sweep [frames]
+//        Run the tx20emulator on the simulated Arduino to produce reference frames, then
+//        decode them again with bit length errors, jitter on the edges and Dtr aborts part
+//        way through the frame. Each condition reports how many frames decoded correctly,
+//        how many were rejected by the header, checksum or inverted fields, and how many
+//        were accepted with the wrong values.
+// ------------------------------------------------------------------------------------------------
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "davis6410.h"
+#include "pins.h"
+#include "sim.h"
+#include "tx20decoder.h"
+#include "tx20emulator.h"
+
+// This matches k_tx20_bit_length in tx20encoder.h.
+constexpr uint32_t k_bit_length = 2000;
+
+// The number of bits in a frame.
+constexpr int k_frame_bits = 41;
+
+// An edge on Txd.
+struct txdedge {
+  int64_t t;
+  bool level;
+};
+
+// A reference frame produced by the emulator, its edges are relative to the frame start.
+struct referenceframe {
+  std::vector<txdedge> edges;
+  tx20frame frame;
+};
+
+// ------------------------------------------------------------------------------------------------
+// Decode mode.
+// ------------------------------------------------------------------------------------------------
+
+static void print_frame(void*, const tx20frame& frame) {
+  printf("%.6f %d %s %d", frame.t / 1e6, frame.direction, winddrn_to_string(frame.direction),
+         frame.speed);
+
+  if (frame.errors & tx20_error_checksum) printf(" checksum");
+  if (frame.errors & tx20_error_direction) printf(" direction");
+  if (frame.errors & tx20_error_speed) printf(" speed");
+
+  printf(frame.errors ? "\n" : " ok\n");
+}
+
+static int decode_csv(const char* path, uint32_t bit_length) {
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    fprintf(stderr, "tx20check: cannot open %s\n", path);
+    return 1;
+  }
+
+  tx20decoder decoder(print_frame, nullptr, bit_length);
+
+  char line[256];
+  uint64_t t = 0;
+  while (fgets(line, sizeof(line), file)) {
+    double seconds;
+    int level;
+    if (sscanf(line, "%lf,%d", &seconds, &level) != 2 || seconds < 0) continue;
+
+    t = static_cast<uint64_t>(seconds * 1e6 + 0.5);
+    decoder.edge(t, level != 0);
+  }
+
+  fclose(file);
+  decoder.flush(t + k_frame_bits * static_cast<uint64_t>(bit_length));
+
+  fprintf(stderr, "tx20check: %u frames, %u bad, %u bad headers\n", decoder.frames(),
+          decoder.bad_frames(), decoder.bad_headers());
+
+  return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Reference frames.
+// The emulator is fed a wind that changes speed and direction every frame, and the Txd
+// writes between the start and end of each frame are captured.
+// ------------------------------------------------------------------------------------------------
+
+struct generator {
+  std::vector<referenceframe> frames;
+  std::vector<txdedge> edges;
+  bool capturing = false;
+  uint64_t frame_t = 0;
+  uint64_t pulse_period = 0;
+  int index = 0;
+};
+
+static generator* active_generator = nullptr;
+
+// Anemometer pulses at the current period.
+static void pulse_input(void* context) {
+  generator* self = static_cast<generator*>(context);
+
+  sim_set_pin(k_wind_sensor_pin, HIGH);
+  sim_set_pin(k_wind_sensor_pin, LOW);
+  sim_set_next_input(sim_time() + self->pulse_period);
+}
+
+// Set up the wind for frame n, roughly 1 to 60 mph and all 16 directions.
+static void set_wind(generator& self, int n) {
+  self.pulse_period = 2250000 / (1 + (n * 7) % 60);
+  sim_set_analog(k_wind_direction_pin, (n * 67) % 1024);
+}
+
+static void capture_txd(void* context, uint64_t t, bool level) {
+  generator* self = static_cast<generator*>(context);
+  if (self->capturing) self->edges.push_back({ static_cast<int64_t>(t - self->frame_t), level });
+}
+
+static void capture_event(tx20event event) {
+  generator& self = *active_generator;
+
+  switch (event) {
+    case tx20event::start_data_frame: {
+        self.capturing = true;
+        self.frame_t = sim_time();
+        self.edges.clear();
+        break;
+      }
+
+    case tx20event::end_data_frame: {
+        self.capturing = false;
+
+        referenceframe reference = referenceframe();
+        reference.edges = self.edges;
+        self.frames.push_back(reference);
+
+        set_wind(self, ++self.index);
+        break;
+      }
+
+    default:
+      break;
+  }
+}
+
+// Decode callback that keeps the last frame.
+struct decoded {
+  bool found = false;
+  tx20frame frame;
+};
+
+static void keep_frame(void* context, const tx20frame& frame) {
+  decoded* result = static_cast<decoded*>(context);
+  result->found = true;
+  result->frame = frame;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Decode a single frame from its edges. The line is low before the frame.
+// ------------------------------------------------------------------------------------------------
+static decoded decode_edges(const std::vector<txdedge>& edges, uint32_t bit_length) {
+  decoded result;
+  tx20decoder decoder(keep_frame, &result, bit_length);
+
+  // Start well clear of zero so that jitter cannot make the times negative.
+  const int64_t origin = 100000;
+  decoder.edge(0, false);
+
+  int64_t last = 0;
+  for (const txdedge& edge : edges) {
+    const int64_t t = origin + edge.t;
+    if (t < last) continue;
+
+    decoder.edge(t, edge.level);
+    last = t;
+  }
+
+  decoder.flush(origin + 2 * k_frame_bits * static_cast<int64_t>(bit_length));
+
+  return result;
+}
+
+static std::vector<referenceframe> make_reference_frames(int count) {
+  generator self;
+  active_generator = &self;
+
+  sim_reset();
+  sim_watch_pin(k_txd_pin, capture_txd, &self);
+
+  davis6410 wind_meter(k_wind_sensor_pin, k_wind_direction_pin);
+  tx20emulator tx20_emulator(k_dtr_pin, k_txd_pin);
+
+  wind_meter.initialise();
+  tx20_emulator.initialise(&wind_meter, capture_event);
+
+  set_wind(self, 0);
+  sim_set_input(pulse_input, &self, 0);
+  sim_set_pin(k_dtr_pin, LOW);
+
+  while (static_cast<int>(self.frames.size()) < count) {
+    wind_meter.service();
+    tx20_emulator.service();
+    sim_advance_to(sim_time() + 1000);
+  }
+
+  active_generator = nullptr;
+
+  // The unperturbed decode is the reference, so it has to be clean or the sweep means nothing.
+  for (referenceframe& reference : self.frames) {
+    const decoded result = decode_edges(reference.edges, k_bit_length);
+    if (!result.found || result.frame.errors) {
+      fprintf(stderr, "tx20check: reference frame %d does not decode cleanly\n",
+              static_cast<int>(&reference - &self.frames[0]));
+      exit(1);
+    }
+
+    reference.frame = result.frame;
+  }
+
+  return self.frames;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Sweep mode.
+// ------------------------------------------------------------------------------------------------
+
+// The outcome of decoding the frames under one condition.
+struct outcome {
+  int ok = 0;
+  int rejected = 0;
+  int wrong = 0;
+};
+
+static void score(outcome& result, const referenceframe& reference, const decoded& frame) {
+  if (!frame.found || frame.frame.errors)
+    ++result.rejected;
+  else if (frame.frame.direction == reference.frame.direction && frame.frame.speed == reference.frame.speed)
+    ++result.ok;
+  else
+    ++result.wrong;
+}
+
+static void print_outcome(const char* condition, double value, const outcome& result) {
+  const double total = result.ok + result.rejected + result.wrong;
+  printf("%-10s %8.2f  ok %6.2f%%  rejected %6.2f%%  wrong %6.2f%%\n", condition, value,
+         100.0 * result.ok / total, 100.0 * result.rejected / total, 100.0 * result.wrong / total);
+}
+
+static int sweep(int count) {
+  const std::vector<referenceframe> frames = make_reference_frames(count);
+  std::mt19937 random(6410);
+
+  // Bit length error, the transmitted bits are longer or shorter than the receiver expects.
+  for (int permille = -50; permille <= 50; permille += 5) {
+    outcome result;
+    for (const referenceframe& reference : frames) {
+      std::vector<txdedge> edges = reference.edges;
+      for (txdedge& edge : edges) edge.t = edge.t * (1000 + permille) / 1000;
+
+      score(result, reference, decode_edges(edges, k_bit_length));
+    }
+
+    print_outcome("bit error%", permille / 10.0, result);
+  }
+
+  // Jitter, each edge moves by up to +/- the given number of microseconds.
+  for (int jitter = 0; jitter <= 1000; jitter += 100) {
+    std::uniform_int_distribution<int> offset(-jitter, jitter);
+
+    outcome result;
+    for (const referenceframe& reference : frames) {
+      std::vector<txdedge> edges = reference.edges;
+      for (txdedge& edge : edges) edge.t += offset(random);
+
+      score(result, reference, decode_edges(edges, k_bit_length));
+    }
+
+    print_outcome("jitter us", jitter, result);
+  }
+
+  // Dtr released part way through the frame, the emulator takes Txd high when disabled.
+  for (int bit = 0; bit <= k_frame_bits; bit += 4) {
+    const int64_t abort_t = static_cast<int64_t>(bit) * k_bit_length;
+
+    outcome result;
+    for (const referenceframe& reference : frames) {
+      std::vector<txdedge> edges;
+      for (const txdedge& edge : reference.edges)
+        if (edge.t < abort_t) edges.push_back(edge);
+
+      edges.push_back({ abort_t, true });
+
+      score(result, reference, decode_edges(edges, k_bit_length));
+    }
+
+    print_outcome("abort bit", bit, result);
+  }
+
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc >= 3 && strcmp(argv[1], "decode") == 0)
+    return decode_csv(argv[2], argc > 3 ? strtoul(argv[3], nullptr, 10) : k_bit_length);
+
+  if (argc >= 2 && strcmp(argv[1], "sweep") == 0)
+    return sweep(argc > 2 ? atoi(argv[2]) : 200);
+
+  fprintf(stderr, "usage: tx20check decode <csv> [bit_us]\n"
+                  "       tx20check sweep [frames]\n");
+  return 2;
+}
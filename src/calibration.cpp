@@ -0,0 +1,67 @@
+// ------------------------------------------------------------------------------------------------
+// Calibration of the Davis 6410 readings.
+// ------------------------------------------------------------------------------------------------
+#include "calibration.h"
+
+#include "calibrationdata.h"
+#include "vanecalibration.h"
+
+// A quarter wave of cosine in steps of 1.5 degrees, scaled by 2^14.
+static const int16_t k_vane_cos[k_vane_steps / 4 + 1] PROGMEM = {
+  16384, 16378, 16362, 16333, 16294, 16244, 16182, 16110, 16026, 15931, 15826,
+  15709, 15582, 15444, 15296, 15137, 14968, 14788, 14598, 14399, 14189, 13970,
+  13741, 13502, 13255, 12998, 12733, 12458, 12176, 11885, 11585, 11278, 10963,
+  10641, 10311, 9974, 9630, 9280, 8923, 8561, 8192, 7818, 7438, 7053,
+  6664, 6270, 5872, 5469, 5063, 4653, 4240, 3825, 3406, 2986, 2563,
+  2139, 1713, 1285, 857, 429, 0,
+};
+
+// ------------------------------------------------------------------------------------------------
+// Apply the anemometer calibration curve.
+// The curve is piecewise linear with evenly spaced points, so the segment is found
+// directly from the top bits of the raw speed and the bottom bits interpolate within it.
+// ------------------------------------------------------------------------------------------------
+uint16_t calibrate_wind_speed(uint16_t raw) {
+  uint8_t segment = raw >> k_anemometer_cal_shift;
+  if (segment > k_anemometer_cal_count - 2) segment = k_anemometer_cal_count - 2;
+
+  const int32_t y0 = pgm_read_word(&k_anemometer_cal[segment]);
+  const int32_t y1 = pgm_read_word(&k_anemometer_cal[segment + 1]);
+  const int32_t dx = raw - (static_cast<uint16_t>(segment) << k_anemometer_cal_shift);
+
+  const int32_t y = y0 + (((y1 - y0) * dx) >> k_anemometer_cal_shift);
+
+  if (y < 0) return 0;
+  if (y > 0xffff) return 0xffff;
+
+  return y;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Map a vane reading to a direction with a single table read.
+// ------------------------------------------------------------------------------------------------
+uint8_t calibrate_wind_vane(uint16_t adc) {
+  return pgm_read_byte(&k_vane_lut[adc & 0x3ff]);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Return the cosine of a vane direction from the quarter wave table.
+// ------------------------------------------------------------------------------------------------
+int16_t vane_cos(uint8_t vane) {
+  constexpr uint8_t quarter = k_vane_steps / 4;
+
+  if (vane < quarter) return pgm_read_word(&k_vane_cos[vane]);
+  if (vane < 2 * quarter) return -pgm_read_word(&k_vane_cos[2 * quarter - vane]);
+  if (vane < 3 * quarter) return -pgm_read_word(&k_vane_cos[vane - 2 * quarter]);
+
+  return pgm_read_word(&k_vane_cos[k_vane_steps - vane]);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Return the sine of a vane direction, ie the cosine a quarter turn earlier.
+// ------------------------------------------------------------------------------------------------
+int16_t vane_sin(uint8_t vane) {
+  constexpr uint8_t quarter = k_vane_steps / 4;
+
+  return vane_cos(vane >= quarter ? vane - quarter : vane + 3 * quarter);
+}
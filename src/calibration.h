@@ -0,0 +1,35 @@
+// ------------------------------------------------------------------------------------------------
+// Calibration of the Davis 6410 readings.
+//
+// The calibration data for a unit is kept in flash in calibrationdata.h, which is generated
+// by the tools in the tools directory. All the calculations are done in integers.
+// ------------------------------------------------------------------------------------------------
+#pragma once
+
+#include <Arduino.h>
+
+// The anemometer curve has a point every 2^k_anemometer_cal_shift hundredths of a mph,
+// so the segment for a speed is found with a shift.
+constexpr uint8_t k_anemometer_cal_shift = 10;
+
+// Apply the anemometer calibration curve to a raw speed.
+// Both speeds are in units of 0.01 mph. Speeds past the end of the curve are extrapolated
+// from the last segment.
+uint16_t calibrate_wind_speed(uint16_t raw);
+
+// The vane directions are in units of 1.5 degrees, so there are 15 per compass sector.
+constexpr uint8_t k_vane_steps = 240;
+constexpr uint8_t k_vane_sector_steps = k_vane_steps / 16;
+
+// The value returned for vane readings in the pot's dead band.
+constexpr uint8_t k_vane_dead_band = 0xff;
+
+// Map a 10 bit adc reading of the vane to a direction in units of 1.5 degrees.
+// The north offset and non-linearity of the pot are taken care of by the table in
+// vanecalibration.h. Returns k_vane_dead_band if the reading is in the dead band.
+uint8_t calibrate_wind_vane(uint16_t adc);
+
+// Return the cosine and sine of a vane direction, scaled by 2^14.
+// These are used to average directions as vectors.
+int16_t vane_cos(uint8_t vane);
+int16_t vane_sin(uint8_t vane);
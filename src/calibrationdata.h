@@ -0,0 +1,18 @@
+// ------------------------------------------------------------------------------------------------
+// Calibration data for this unit's Davis 6410.
+//
+// Generated by tools/fit_calibration.py, do not edit by hand.
+// ------------------------------------------------------------------------------------------------
+#pragma once
+
+#include <Arduino.h>
+
+// Anemometer calibration curve.
+// Entry i is the calibrated speed for a raw speed of i * 10.24 mph, both in units of
+// 0.01 mph. This curve is the identity, ie uncalibrated.
+constexpr uint8_t k_anemometer_cal_count = 21;
+
+const uint16_t k_anemometer_cal[k_anemometer_cal_count] PROGMEM = {
+  0, 1024, 2048, 3072, 4096, 5120, 6144, 7168, 8192, 9216, 10240,
+  11264, 12288, 13312, 14336, 15360, 16384, 17408, 18432, 19456, 20480,
+};
@@ -8,9 +8,15 @@
 #include "davis6410.h"
 
 #include <math.h>
+#include <util/atomic.h>
 
-using microseconds_t = unsigned long;
-using milliseconds_t = unsigned long;
+#include "calibration.h"
+#include "flightrecorder.h"
+#include "sensorrecorder.h"
+
+// Timestamps are the width of millis() and micros(), so that differences wrap correctly.
+using microseconds_t = uint32_t;
+using milliseconds_t = uint32_t;
 
 // The counter for the wind pulses.
 // The anenometer spins at 1600 rev/hrs at 1 mph, or 0.444r pulses per second
@@ -22,19 +28,190 @@ static volatile uint8_t wind_speed_pulse_counter = 0;
 // This variable is needed to debounce the reed switch.
 static volatile milliseconds_t debounce_start_t = 0;
 
+// The debounce period in milliseconds, a byte so the isr can read it without a lock.
+static volatile uint8_t wind_pulse_debounce = k_wind_pulse_debounce;
+
+// The number of pulses rejected by the debounce in the current sample period.
+// This is saturated rather than allowed to wrap.
+static volatile uint8_t wind_speed_reject_counter = 0;
+
+// Set if the pulse counter wrapped in the current sample period.
+static volatile bool wind_speed_pulse_overflow = false;
+
+// The number of edges in the current sample period that came sooner after the previous
+// edge than the cups can physically turn. This is saturated rather than allowed to wrap.
+static volatile uint8_t wind_speed_glitch_counter = 0;
+
+// The time of the last edge, whether or not it was rejected by the debounce.
+static volatile milliseconds_t last_edge_t = 0;
+
+// The times of the pulses that got past the debounce, for the interpolated speed.
+//    wind_pulse_first_us - the first pulse of the current sample period
+//    wind_pulse_last_us - the last pulse, this is kept from one sample period to the next
+//    wind_pulse_seen - set once there has been a pulse
+static volatile microseconds_t wind_pulse_first_us = 0;
+static volatile microseconds_t wind_pulse_last_us = 0;
+static volatile bool wind_pulse_seen = false;
+
+// When sampling the direction weighted by wind run, the vane is read after each pulse and
+// the readings are summed as vectors. The adc channel is that of the vane pin.
+static volatile bool wind_vane_per_pulse = false;
+static volatile bool wind_vane_conversion_pending = false;
+static uint8_t wind_vane_channel = 0;
+static volatile int32_t wind_vane_sum_x = 0;
+static volatile int32_t wind_vane_sum_y = 0;
+static volatile uint8_t wind_vane_sum_count = 0;
+static volatile uint16_t wind_vane_last_adc = 0;
+
+// --------------------------------------------------------------------------------------------------------------------
+// Add a vane reading to the run weighted sums.
+// Readings in the dead band are left out.
+// --------------------------------------------------------------------------------------------------------------------
+static void accumulate_vane(uint16_t adc) {
+  wind_vane_last_adc = adc;
+
+  const uint8_t vane = calibrate_wind_vane(adc);
+  if (vane == k_vane_dead_band || wind_vane_sum_count == 0xff) return;
+
+  wind_vane_sum_x += vane_cos(vane);
+  wind_vane_sum_y += vane_sin(vane);
+  ++wind_vane_sum_count;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Start a conversion of the vane.
+// On the AVR the conversion runs in the background and the result is picked up by the adc
+// isr, so the pulse isr doesn't wait for it.
+// --------------------------------------------------------------------------------------------------------------------
+static void start_vane_conversion() {
+#if defined(__AVR__)
+  if (wind_vane_conversion_pending) return;
+
+  wind_vane_conversion_pending = true;
+  ADMUX = _BV(REFS0) | (wind_vane_channel & 0x07);
+  ADCSRA |= _BV(ADIE) | _BV(ADSC);
+#else
+  accumulate_vane(analogRead(wind_vane_channel));
+#endif
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Stop the per pulse conversions so that the vane can be read with analogRead().
+// A conversion started by the last pulse may still be running, and analogRead() must not
+// start its own on top of it. The adc interrupt is turned off again so that later
+// conversions started by analogRead() don't run the adc isr.
+// --------------------------------------------------------------------------------------------------------------------
+static void stop_vane_conversions() {
+  wind_vane_per_pulse = false;
+
+#if defined(__AVR__)
+  while (ADCSRA & _BV(ADSC)) {}
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    // Writing a 1 to ADIF clears it.
+    ADCSRA = (ADCSRA & ~_BV(ADIE)) | _BV(ADIF);
+    wind_vane_conversion_pending = false;
+  }
+#endif
+}
+
+#if defined(__AVR__)
+// --------------------------------------------------------------------------------------------------------------------
+// The adc conversion complete isr.
+// The interrupt is only enabled while pulses start conversions, and a conversion that
+// wasn't started by a pulse is ignored.
+// --------------------------------------------------------------------------------------------------------------------
+ISR(ADC_vect) {
+  if (!wind_vane_conversion_pending) return;
+
+  wind_vane_conversion_pending = false;
+  accumulate_vane(ADC);
+}
+#endif
+
 // --------------------------------------------------------------------------------------------------------------------
 // The isr for servicing the wind speed reading.
 // The variable debounce_start_t should be cleared before the first interrupt of
 // a sample period.
 // --------------------------------------------------------------------------------------------------------------------
 static void isr_6410() {
+  // When recording a sensor trace, the raw edges are recorded before the debounce.
+  const microseconds_t now_us = micros();
+  if (sensor_recorder.recording()) sensor_recorder.record_edge(now_us);
+
   milliseconds_t now = millis();
-  if (now - debounce_start_t >= k_wind_pulse_debounce) {
-    ++wind_speed_pulse_counter;
+
+  if (now - last_edge_t < k_health_min_pulse_interval && wind_speed_glitch_counter != 0xff)
+    ++wind_speed_glitch_counter;
+  last_edge_t = now;
+
+  if (now - debounce_start_t >= wind_pulse_debounce) {
+    if (++wind_speed_pulse_counter == 0) wind_speed_pulse_overflow = true;
     debounce_start_t = now;
+
+    if (wind_speed_pulse_counter == 1 && !wind_speed_pulse_overflow) wind_pulse_first_us = now_us;
+    wind_pulse_last_us = now_us;
+    wind_pulse_seen = true;
+
+    if (wind_vane_per_pulse) start_vane_conversion();
+  }
+  else if (wind_speed_reject_counter != 0xff) {
+    ++wind_speed_reject_counter;
   }
 }
 
+// --------------------------------------------------------------------------------------------------------------------
+// Return a / b in 256ths, a must be no more than b.
+// Long times are scaled down first so that a * 256 fits in 32 bits.
+// --------------------------------------------------------------------------------------------------------------------
+static uint16_t fraction_256(microseconds_t a, microseconds_t b) {
+  while (b >= 0x1000000UL) {
+    a >>= 1;
+    b >>= 1;
+  }
+
+  return b ? static_cast<uint16_t>((a << 8) / b) : 0;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Work out the revolutions in a sample period in 256ths from the pulse times.
+// There are pulses - 1 whole revolutions between the first and the last pulse. Before the
+// first is the part of the revolution since the pulse before the period, and after the last
+// is the part of a revolution at the mean rate, up to a whole one. If the pulse before the
+// period was more than a period before it, eg the wind has just got up, the part before the
+// first is also at the mean rate. With a single pulse and nothing to go on it counts as a
+// whole revolution.
+// --------------------------------------------------------------------------------------------------------------------
+static uint16_t interpolate_revolutions(uint8_t pulses, microseconds_t start_us, microseconds_t end_us,
+                                        bool lead_pulse, microseconds_t lead_us,
+                                        microseconds_t first_us, microseconds_t last_us) {
+  if (pulses == 0) return 0;
+
+  uint32_t revolutions = static_cast<uint32_t>(pulses - 1) << 8;
+  microseconds_t rev_us = pulses > 1 ? (last_us - first_us) / (pulses - 1) : 0;
+
+  // The revolution the period started part way through.
+  const microseconds_t before = first_us - start_us;
+
+  if (lead_pulse && start_us - lead_us <= end_us - start_us) {
+    const microseconds_t lead = first_us - lead_us;
+    revolutions += fraction_256(before, lead);
+    if (!rev_us) rev_us = lead;
+  }
+  else if (rev_us) {
+    revolutions += fraction_256(before < rev_us ? before : rev_us, rev_us);
+  }
+  else {
+    revolutions += 256;
+  }
+
+  // The revolution that was under way when the period ended.
+  const microseconds_t after = end_us - last_us;
+  if (rev_us) revolutions += fraction_256(after < rev_us ? after : rev_us, rev_us);
+
+  return revolutions > 0xffff ? 0xffff : static_cast<uint16_t>(revolutions);
+}
+
 // --------------------------------------------------------------------------------------------------------------------
 // Constructor does not initialise the hardware.
 // --------------------------------------------------------------------------------------------------------------------
@@ -52,13 +229,29 @@ void davis6410::initialise() {
   pinMode(wind_speed_pin_, INPUT);
   attachInterrupt(digitalPinToInterrupt(wind_speed_pin_), isr_6410, FALLING);
 
-  state_ = davis6410state::idle;
+  wind_vane_channel = wind_vane_pin_ >= A0 ? wind_vane_pin_ - A0 : wind_vane_pin_;
+
   initialised_ = true;
+  set_state(davis6410state::idle);
 
   // Interrupts enabled.
   sei();
 }
 
+// --------------------------------------------------------------------------------------------------------------------
+// Set how the wind direction is sampled.
+// --------------------------------------------------------------------------------------------------------------------
+void davis6410::set_direction_mode(davis6410direction mode) {
+  direction_mode_ = mode;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Set the debounce period for the wind speed pulses.
+// --------------------------------------------------------------------------------------------------------------------
+void davis6410::set_debounce(uint8_t debounce) {
+  wind_pulse_debounce = debounce;
+}
+
 // --------------------------------------------------------------------------------------------------------------------
 // Start a new sample.
 // The callback will be called when the sample is ready.
@@ -70,7 +263,7 @@ bool davis6410::start_sample(windsamplefn fn, void* context) {
   sample_fn_ = fn;
   context_ = context;
 
-  state_ = davis6410state::new_sample;
+  set_state(davis6410state::new_sample);
 
   return true;
 }
@@ -90,8 +283,9 @@ void davis6410::abort_sample() {
     case davis6410state::sampling_speed:
     case davis6410state::sampling_direction:
     case davis6410state::send_frame: {
+      stop_vane_conversions();
       sample_fn_ = nullptr;
-      state_ = davis6410state::idle;
+      set_state(davis6410state::idle);
       break;
     }
   }
@@ -108,10 +302,27 @@ void davis6410::service() {
 
     case davis6410state::new_sample: {
       // Start a new sample off.
-      wind_speed_pulse_counter = 0;
+      wind_speed_reject_counter = 0;
+      wind_speed_glitch_counter = 0;
+      wind_speed_pulse_overflow = false;
+
+      // The pulse counter is cleared along with the start time, so that a pulse is either
+      // before the period or counted in it. The time is read first as it is the slow part.
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        sample_start_us_ = micros();
+        wind_speed_pulse_counter = 0;
+        sample_lead_pulse_us_ = wind_pulse_last_us;
+        sample_lead_pulse_ = wind_pulse_seen;
+
+        wind_vane_sum_x = 0;
+        wind_vane_sum_y = 0;
+        wind_vane_sum_count = 0;
+      }
+
+      wind_vane_per_pulse = direction_mode_ == davis6410direction::run_weighted;
       sample_start_time_ = millis();
 
-      state_ = davis6410state::sampling_speed;
+      set_state(davis6410state::sampling_speed);
 
       break;
     }
@@ -119,27 +330,67 @@ void davis6410::service() {
     case davis6410state::sampling_speed: {
       // Check if the sample frame has finished.
       if (millis() - sample_start_time_ >= sample_period_) {
-        sample_pulse_count_ = wind_speed_pulse_counter;
+        microseconds_t end_us;
+        microseconds_t first_us;
+        microseconds_t last_us;
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+          end_us = micros();
+          sample_pulse_count_ = wind_speed_pulse_counter;
+          first_us = wind_pulse_first_us;
+          last_us = wind_pulse_last_us;
+        }
+
+        sample_reject_count_ = wind_speed_reject_counter;
+
+        if (sample_reject_count_)
+          flight_recorder.log(end_us, traceid::pulse_rejects, sample_reject_count_);
+
+        sample_overflow_ = wind_speed_pulse_overflow;
+
+        if (sample_overflow_)
+          flight_recorder.log(end_us, traceid::pulse_overflow, 1);
+
+        // The interpolated speed saturates if the pulse counter overflowed.
+        sample_period_us_ = end_us - sample_start_us_;
+        sample_revolutions_ = sample_overflow_ ? 0xffff :
+          interpolate_revolutions(sample_pulse_count_, sample_start_us_, end_us, sample_lead_pulse_,
+                                  sample_lead_pulse_us_, first_us, last_us);
 
         // Sample the wind direction.
-        state_ = davis6410state::sampling_direction;
+        set_state(davis6410state::sampling_direction);
       }
 
       break;
     }
 
     case davis6410state::sampling_direction: {
-      // Read the wind direction directly.
-      sample_direction_ = analogRead(wind_vane_pin_);
+      // Use the run weighted direction if there is one, otherwise read the vane directly.
+      stop_vane_conversions();
 
-      state_ = davis6410state::send_frame;
+      uint8_t vane = run_weighted_direction();
+      if (vane == k_vane_dead_band) {
+        sample_direction_ = analogRead(wind_vane_pin_);
+        vane = calibrate_wind_vane(sample_direction_);
+      }
+      else {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { sample_direction_ = wind_vane_last_adc; }
+      }
+
+      update_direction(vane);
+
+      health_.update(sample_pulse_count_, sample_reject_count_, wind_speed_glitch_counter,
+                     sample_direction_, get_wind_degrees());
+
+      set_state(davis6410state::send_frame);
 
       break;
     }
 
     case davis6410state::send_frame: {
       // Ready for another sample.
-      state_ = davis6410state::idle;
+      set_state(davis6410state::idle);
+      ++sample_count_;
 
       // Let the client know the sampled wind speed and direction.
       if (sample_fn_) sample_fn_(context_);
@@ -151,23 +402,113 @@ void davis6410::service() {
 
 // --------------------------------------------------------------------------------------------------------------------
 // Return the last sampled wind speed.
-// The calcualtion from pulse count to mph uses the formula V=P(2.25/T). If we
-// find that it is not accurate enough we could use calibration tables etc for
-// greateer accuracy.
 // --------------------------------------------------------------------------------------------------------------------
 float davis6410::get_wind_mph() const {
-  return sample_pulse_count_ * 2.25f * 1000.f /
-         static_cast<float>(sample_period_);
+  if (speed_mode_ == davis6410speed::interpolated)
+    return calculate_wind_mph(sample_revolutions_, sample_period_us_);
+
+  return calculate_wind_mph(sample_pulse_count_);
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Convert pulses to mph.
+// The raw speed comes from the formula V=P(2.25/T) and is then corrected with the
+// anemometer calibration curve. The calculation is done in hundredths of a mph.
+// --------------------------------------------------------------------------------------------------------------------
+float davis6410::calculate_wind_mph(uint8_t pulses) const {
+  uint32_t raw = pulses * 225000UL / sample_period_;
+  if (raw > 0xffff) raw = 0xffff;
+
+  return calibrate_wind_speed(raw) / 100.f;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Convert revolutions in 256ths over a period in microseconds to mph.
+// This is the same formula in fixed point. With the period in units of 100 us the factor is
+// 2.25 * 10^6 / 256 = 8789.0625, which is applied as 8789 + 1/16 to stay within 32 bits.
+// --------------------------------------------------------------------------------------------------------------------
+float davis6410::calculate_wind_mph(uint16_t revolutions, uint32_t period_us) const {
+  const uint32_t period = period_us / 100;
+  if (!period) return 0;
+
+  uint32_t raw = (revolutions * 8789UL + revolutions / 16) / period;
+  if (raw > 0xffff) raw = 0xffff;
+
+  return calibrate_wind_speed(raw) / 100.f;
 }
 
 // --------------------------------------------------------------------------------------------------------------------
 // Return the last sampled wind direction.
-// The calcualtio from pulse count to mph uses the formula V=P(2.25/T). If we
-// find that it is not accurate enough we could use calibration tables etc for
-// greateer accuracy.
+// Returns the direction as 0=N, E=4 etc.
 // --------------------------------------------------------------------------------------------------------------------
 int davis6410::get_wind_direction() const {
-  return (sample_direction_ + 31) >> 6;
+  return sample_sector_;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Return the faults found by the health monitor.
+// --------------------------------------------------------------------------------------------------------------------
+uint8_t davis6410::get_health() const {
+  return health_.faults();
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Return the last sampled wind direction in tenths of a degree.
+// --------------------------------------------------------------------------------------------------------------------
+uint16_t davis6410::get_wind_bearing() const {
+  return sample_vane_ * 15;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Return the last sampled wind direction in degrees.
+// --------------------------------------------------------------------------------------------------------------------
+int davis6410::get_wind_degrees() const {
+  return sample_vane_ * 3 / 2;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Update the direction from a vane direction.
+// The sector only changes if the direction is more than the hysteresis past
+// the edge of the current sector. Readings in the dead band leave the direction as it was.
+// --------------------------------------------------------------------------------------------------------------------
+void davis6410::update_direction(uint8_t vane) {
+  sample_dead_band_ = vane == k_vane_dead_band;
+  if (sample_dead_band_) return;
+
+  sample_vane_ = vane;
+
+  // The distance from the centre of the current sector, wrapped to +/- half a turn.
+  int offset = vane - sample_sector_ * k_vane_sector_steps;
+  if (offset >= k_vane_steps / 2) offset -= k_vane_steps;
+  if (offset < -k_vane_steps / 2) offset += k_vane_steps;
+
+  if (2 * abs(offset) > k_vane_sector_steps + 2 * direction_hysteresis_)
+    sample_sector_ = ((vane * 2 + k_vane_sector_steps) / (2 * k_vane_sector_steps)) & 0xf;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Return the run weighted mean direction of the last sample period.
+// This is the direction of the sum of the vane vectors. It's only worked out once per
+// sample so floating point is fine here.
+// --------------------------------------------------------------------------------------------------------------------
+uint8_t davis6410::run_weighted_direction() const {
+  int32_t x;
+  int32_t y;
+  uint8_t count;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    x = wind_vane_sum_x;
+    y = wind_vane_sum_y;
+    count = wind_vane_sum_count;
+  }
+
+  if (count == 0 || (x == 0 && y == 0)) return k_vane_dead_band;
+
+  float steps = atan2(static_cast<float>(y), static_cast<float>(x)) * (k_vane_steps / (2 * M_PI));
+  if (steps < 0) steps += k_vane_steps;
+
+  const uint8_t vane = static_cast<uint8_t>(steps + 0.5f);
+  return vane >= k_vane_steps ? vane - k_vane_steps : vane;
 }
 
 // --------------------------------------------------------------------------------------------------------------------
@@ -178,3 +519,19 @@ uint8_t davis6410::get_pulses() const {
   return sample_pulse_count_;
 }
 
+
+// --------------------------------------------------------------------------------------------------------------------
+// Return the number of pulses rejected by the debounce in the last sample.
+// A high count suggests contact bounce or noise on the anenometer line.
+// --------------------------------------------------------------------------------------------------------------------
+uint8_t davis6410::get_debounce_rejects() const {
+  return sample_reject_count_;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Set the state of the Davis 6410 and log the transition in the flight recorder.
+// --------------------------------------------------------------------------------------------------------------------
+void davis6410::set_state(davis6410state state) {
+  state_ = state;
+  flight_recorder.log(traceid::davis6410_state, static_cast<uint8_t>(state));
+}
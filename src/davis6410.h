@@ -9,6 +9,7 @@
 
 #include <Arduino.h>
 
+#include "sensorhealth.h"
 #include "windmeterintf.h"
 
 // This is the default duration over which the wind speed is calculated.
@@ -24,6 +25,11 @@ constexpr unsigned long k_wind_speed_sample_t = 2250;
 // period), hece something in the range 1 to 20 ms will do.
 constexpr unsigned long k_wind_pulse_debounce = 18;
 
+// Hysteresis on the wind direction in units of 1.5 degrees.
+// The direction only moves to a new sector once it is this far past the sector boundary,
+// which stops the reported direction flickering when the wind sits on a boundary.
+constexpr uint8_t k_wind_direction_hysteresis = 3;
+
 // The state for the 6410.
 //    idle - the 6410 is doing nothing
 //    new_sample - a new sample has been requested
@@ -36,6 +42,28 @@ enum class davis6410state {
   send_frame,
 };
 
+// How the wind direction is sampled.
+//    instant - the vane is read once at the end of the sample period
+//    run_weighted - the vane is read on every anenometer pulse and the readings are
+//                   averaged as vectors, so each direction is weighted by the wind run.
+//                   If there were no pulses the vane is read once as for instant.
+enum class davis6410direction {
+  instant,
+  run_weighted,
+};
+
+// How the wind speed is worked out.
+//    pulse_count - the pulses in the sample period, so the speed is a whole number of
+//                  revolutions per period, 1 mph steps with the default period
+//    interpolated - the revolutions between the first and last pulse of the period, plus
+//                   the fractions of a revolution before the first and after the last,
+//                   divided by the exact length of the period. The fractions are worked
+//                   out from the pulse times, so the speed resolves well below 1 mph.
+enum class davis6410speed {
+  pulse_count,
+  interpolated,
+};
+
 class davis6410 : public windmeterintf {
  public:
   // The Davis runs off two pins, a digital input for the wind speed pulses and
@@ -50,6 +78,20 @@ class davis6410 : public windmeterintf {
   // This must be done once before the 6410 can be used.
   void initialise();
 
+  // Set how the wind direction is sampled, this takes effect from the next sample.
+  void set_direction_mode(davis6410direction mode);
+
+  // Set how the wind speed is worked out, this takes effect from the next sample.
+  void set_speed_mode(davis6410speed mode) { speed_mode_ = mode; }
+
+  // Set the debounce period for the wind speed pulses in milliseconds.
+  // The default is k_wind_pulse_debounce. There is only one debounce for all instances.
+  void set_debounce(uint8_t debounce);
+
+  // Set the hysteresis on the wind direction in units of 1.5 degrees.
+  // The default is k_wind_direction_hysteresis.
+  void set_direction_hysteresis(uint8_t hysteresis) { direction_hysteresis_ = hysteresis; }
+
   // Service the interface.
   void service();
 
@@ -68,17 +110,53 @@ class davis6410 : public windmeterintf {
   // Returns the direction as 0=N, E=4 etc.
   int get_wind_direction() const override;
 
+  // Return the faults found by the health monitor, a combination of sensorfault.
+  uint8_t get_health() const override;
+
+  // Return the number of samples taken so far.
+  uint8_t get_sample_count() const override { return sample_count_; }
+
+  // Return the last sampled wind direction in tenths of a degree, in steps of 1.5 degrees.
+  uint16_t get_wind_bearing() const override;
+
+  // Return the last sampled wind direction in degrees.
+  int get_wind_degrees() const;
+
+  // Return true if the last vane reading was in the pot's dead band.
+  // The direction is held at its previous value while the vane is in the dead band.
+  bool vane_in_dead_band() const { return sample_dead_band_; }
+
   // Return the last sampled anenometer pulse count.
   uint8_t get_pulses() const;
 
+  // Return the number of pulses rejected by the debounce in the last sample.
+  uint8_t get_debounce_rejects() const;
+
+  // Return true if the pulse counter overflowed in the last sample.
+  bool pulse_overflow() const { return sample_overflow_; }
+
   // Return the state of the Davis 6410.
   davis6410state state() const { return state_; }
 
  private:
   // Convert pulses to mph.
-  // Note, this may in the future apply calibration data to the result.
+  // The anemometer calibration curve is applied to the result.
   float calculate_wind_mph(uint8_t pulses) const;
 
+  // Convert revolutions in 1/256ths over a period in microseconds to mph.
+  // The anemometer calibration curve is applied to the result.
+  float calculate_wind_mph(uint16_t revolutions, uint32_t period_us) const;
+
+  // Update the direction from a vane direction, applying the hysteresis.
+  void update_direction(uint8_t vane);
+
+  // Return the run weighted mean direction of the last sample period.
+  // Returns k_vane_dead_band if there were no pulses.
+  uint8_t run_weighted_direction() const;
+
+  // Set the state and record the transition.
+  void set_state(davis6410state state);
+
   // A digital pin is used to counting the anenometer pulses.
   const int wind_speed_pin_;
 
@@ -94,14 +172,53 @@ class davis6410 : public windmeterintf {
   // The state of the interface.
   davis6410state state_ = davis6410state::idle;
 
+  // How the wind direction is sampled.
+  davis6410direction direction_mode_ = davis6410direction::instant;
+
+  // The hysteresis on the wind direction in units of 1.5 degrees.
+  uint8_t direction_hysteresis_ = k_wind_direction_hysteresis;
+
+  // How the wind speed is worked out.
+  davis6410speed speed_mode_ = davis6410speed::pulse_count;
+
   // This is the start time in milliseconds of the current sample frame.
-  unsigned long sample_start_time_;
+  uint32_t sample_start_time_;
+
+  // The start time of the current sample frame in microseconds, the last pulse before it
+  // and whether there has been one, for the interpolated speed.
+  uint32_t sample_start_us_ = 0;
+  uint32_t sample_lead_pulse_us_ = 0;
+  bool sample_lead_pulse_ = false;
+
+  // The interpolated revolutions in 1/256ths and the length in microseconds of the last
+  // sample frame.
+  uint16_t sample_revolutions_ = 0;
+  uint32_t sample_period_us_ = 0;
 
   // This is the pulse count for the last sample frame.
   uint8_t sample_pulse_count_;
 
+  // This is the number of pulses rejected by the debounce in the last sample frame.
+  uint8_t sample_reject_count_ = 0;
+
+  // True if the pulse counter overflowed in the last sample frame.
+  bool sample_overflow_ = false;
+
+  // The number of samples taken, it wraps.
+  uint8_t sample_count_ = 0;
+
   // This is the last analogue reading for the wind direction.
-  int sample_direction_;
+  int sample_direction_ = 0;
+
+  // Watches the readings for signs of a faulty sensor.
+  sensorhealth health_;
+
+  // The last wind direction in units of 1.5 degrees, and its compass sector.
+  uint8_t sample_vane_ = 0;
+  uint8_t sample_sector_ = 0;
+
+  // True if the last vane reading was in the dead band.
+  bool sample_dead_band_ = false;
 
   // The wind sample callback function.
   windsamplefn sample_fn_ = nullptr;
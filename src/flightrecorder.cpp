@@ -0,0 +1,68 @@
+// ------------------------------------------------------------------------------------------------
+// A small flight recorder for diagnosing timing problems in the field.
+//
+// The records are held in a ring buffer. Interrupts are disabled while a record is added
+// or read so that records logged from the anemometer isr are never torn.
+// ------------------------------------------------------------------------------------------------
+#include "flightrecorder.h"
+
+#include <util/atomic.h>
+
+flightrecorder flight_recorder;
+
+// ------------------------------------------------------------------------------------------------
+// Add a record to the flight recorder.
+// ------------------------------------------------------------------------------------------------
+void flightrecorder::log(uint32_t t, traceid id, uint8_t arg) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    tracerecord& record = records_[next_];
+    record.t = t;
+    record.id = id;
+    record.arg = arg;
+
+    next_ = (next_ + 1) & (k_trace_record_count - 1);
+    if (count_ != k_trace_record_count) ++count_;
+  }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Write the records out, oldest first.
+// The dump starts with a "trace <n>" line, and is followed by one line per record
+// holding the timestamp, id and argument in hex.
+// ------------------------------------------------------------------------------------------------
+void flightrecorder::dump(Print& out) const {
+  uint8_t count;
+  uint8_t index;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    count = count_;
+    index = (next_ - count_) & (k_trace_record_count - 1);
+  }
+
+  out.print(F("trace "));
+  out.println(count);
+
+  for (uint8_t i = 0; i < count; ++i) {
+    tracerecord record;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { record = records_[index]; }
+    index = (index + 1) & (k_trace_record_count - 1);
+
+    out.print(record.t, HEX);
+    out.print(' ');
+    out.print(static_cast<uint8_t>(record.id), HEX);
+    out.print(' ');
+    out.println(record.arg, HEX);
+  }
+
+  out.println(F("end"));
+}
+
+// ------------------------------------------------------------------------------------------------
+// Remove all the records.
+// ------------------------------------------------------------------------------------------------
+void flightrecorder::clear() {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    next_ = 0;
+    count_ = 0;
+  }
+}
@@ -0,0 +1,77 @@
+// ------------------------------------------------------------------------------------------------
+// A small flight recorder for diagnosing timing problems in the field.
+//
+// The recorder keeps the most recent state transitions and events in a ring buffer in
+// SRAM. Each record is 6 bytes, a 32 bit timestamp in microseconds, an id and an
+// argument. Logging a record is cheap and safe from within an isr. The contents can be
+// dumped over serial and decoded on the host with tools/trace_decode.py.
+// ------------------------------------------------------------------------------------------------
+#pragma once
+
+#include <Arduino.h>
+
+// The number of records kept by the flight recorder.
+// When the buffer is full, the oldest record is overwritten. This must be a power of 2 so
+// that the ring index wraps with a mask.
+constexpr uint8_t k_trace_record_count = 32;
+static_assert((k_trace_record_count & (k_trace_record_count - 1)) == 0,
+              "k_trace_record_count must be a power of 2");
+
+// These are the types of record in the flight recorder.
+// The argument for each type is,
+//    davis6410_state - the new davis6410state
+//    tx20_state - the new tx20state
+//    tx20_event - the tx20event raised
+//    dtr_edge - the new level of Dtr
+//    pulse_rejects - number of pulses rejected by the debounce in the last sample
+//    pulse_overflow - the pulse counter wrapped in the last sample
+// Note, the values must match those in tools/trace_decode.py.
+enum class traceid : uint8_t {
+  davis6410_state,
+  tx20_state,
+  tx20_event,
+  dtr_edge,
+  pulse_rejects,
+  pulse_overflow
+};
+
+// A single flight recorder record.
+struct tracerecord {
+  uint32_t t;
+  traceid id;
+  uint8_t arg;
+};
+
+class flightrecorder {
+
+public:
+
+  // Add a record to the flight recorder, t is the time in microseconds.
+  // Callers that already have the time pass it in rather than read micros() again.
+  // This may be called from within an isr.
+  void log(uint32_t t, traceid id, uint8_t arg);
+
+  // Add a record timestamped now.
+  void log(traceid id, uint8_t arg) { log(micros(), id, arg); }
+
+  // Write the records out in a text form that tools/trace_decode.py can read.
+  // The records are written oldest first.
+  void dump(Print& out) const;
+
+  // Remove all the records.
+  void clear();
+
+private:
+
+  // The ring buffer of records.
+  tracerecord records_[k_trace_record_count];
+
+  // The index of the slot the next record will be written to.
+  uint8_t next_ = 0;
+
+  // The number of records in the buffer.
+  uint8_t count_ = 0;
+};
+
+// There is only the one flight recorder which all the classes log to.
+extern flightrecorder flight_recorder;
@@ -1,13 +1,34 @@
 // ------------------------------------------------------------------------------------------------
 // This is a simple class for controlling an led on one of the digital io pins.
-// An led can be turned on, off or flahsed. After creating an led instance, call
-// service() from the main loop. This will ensure that flash() works smoothly.
+//
+// All the leds are kept in a list and updated from the timer 2 compare interrupt, which runs
+// every k_led_tick_ms. Timer 2 is started the first time an led is flashed or plays a
+// pattern, after the Arduino core has set the timers up.
 // ------------------------------------------------------------------------------------------------
 
 #include "led.h"
 
+#include <util/atomic.h>
+
+// Each step of a blink pattern is a byte. The top bit is the state of the led and the rest
+// is how long the step lasts in ticks. A zero ends the pattern, which then repeats.
+constexpr uint8_t k_on = 0x80;
+constexpr uint8_t k_off = 0x00;
+
+static const uint8_t k_pattern_dtr_active[] PROGMEM = { k_on | 5, k_off | 95, 0 };
+static const uint8_t k_pattern_sampling[] PROGMEM = { k_on | 2, k_off | 99, k_off | 99, 0 };
+static const uint8_t k_pattern_sensor_fault[] PROGMEM = {
+  k_on | 15, k_off | 15, k_on | 15, k_off | 15, k_on | 15, k_off | 100, 0 };
+static const uint8_t k_pattern_overflow[] PROGMEM = { k_on | 50, k_off | 30, k_on | 50, k_off | 100, 0 };
+
+// The patterns in the order of ledpattern, none has no pattern.
+static const uint8_t* const k_patterns[] = {
+  nullptr, k_pattern_dtr_active, k_pattern_sampling, k_pattern_sensor_fault, k_pattern_overflow };
+
+led* led::first_ = nullptr;
+
 // ------------------------------------------------------------------------------------------------
-// Constructor sets the io poin for the led.
+// Constructor sets the io poin for the led and adds it to the list.
 // ------------------------------------------------------------------------------------------------
 led::led(uint8_t pin, bool state)
   :led_pin_{pin}, mode_{state ? ledmode::on : ledmode::off}
@@ -16,13 +37,27 @@ led::led(uint8_t pin, bool state)
 
   if (state) on();
   else off();
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    next_ = first_;
+    first_ = this;
+  }
 }
 
 // ------------------------------------------------------------------------------------------------
-// Destructor ensures the led is turned off.
+// Destructor ensures the led is turned off and removed from the list.
 // ------------------------------------------------------------------------------------------------
 led::~led()
 {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    for (led** p = &first_; *p; p = &(*p)->next_) {
+      if (*p == this) {
+        *p = next_;
+        break;
+      }
+    }
+  }
+
   set(false);
 }
 
@@ -31,8 +66,11 @@ led::~led()
 // ------------------------------------------------------------------------------------------------
 void led::on()
 {
-  set(true);
-  mode_ = ledmode::on;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    flash_ticks_ = 0;
+    mode_ = ledmode::on;
+    set(true);
+  }
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -40,8 +78,11 @@ void led::on()
 // ------------------------------------------------------------------------------------------------
 void led::off()
 {
-  set(false);
-  mode_ = ledmode::off;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    flash_ticks_ = 0;
+    mode_ = ledmode::off;
+    set(false);
+  }
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -50,39 +91,91 @@ void led::off()
 // ------------------------------------------------------------------------------------------------
 void led::flash(uint16_t period_ms)
 {
-  set(true);
+  start_timer();
 
-  led_start_t_ = millis() & 0xffff;
-  led_period_ = period_ms;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    flash_ticks_ = period_ms / k_led_tick_ms + 1;
+    set(true);
+  }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Play a blink pattern from the start.
+// ------------------------------------------------------------------------------------------------
+void led::play(ledpattern pattern)
+{
+  const uint8_t* steps = k_patterns[static_cast<uint8_t>(pattern)];
+
+  if (!steps) {
+    off();
+    return;
+  }
 
-  mode_ = ledmode::flash;
+  start_timer();
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    // Carry on if the pattern is already playing, so that it doesn't stutter.
+    if (mode_ == ledmode::pattern && pattern_ == steps) return;
+
+    pattern_ = steps;
+    step_ = 0;
+    mode_ = ledmode::pattern;
+    next_step();
+  }
 }
 
 // ------------------------------------------------------------------------------------------------
-// Service the led.
-// The on and off states don't need anything doing, but the flash does need
-// checking to see if the led needs turning off.
+// Advance all the leds by one tick.
 // ------------------------------------------------------------------------------------------------
-void led::service()
+void led::tick()
 {
-  switch (mode_)
-  {
-    case ledmode::off:
-    case ledmode::on:
-      // These states don't need anything doing.
-      break;
-
-    case ledmode::flash:
-      {
-        if (millis() - led_start_t_ > led_period_)
-        {
-          set(false);
-          mode_ = ledmode::off;
-        }
+  for (led* p = first_; p; p = p->next_) p->update();
+}
 
+// ------------------------------------------------------------------------------------------------
+// Advance this led by one tick.
+// A flash takes priority over the pattern, which keeps time underneath it.
+// ------------------------------------------------------------------------------------------------
+void led::update()
+{
+  const bool flashing = flash_ticks_ != 0;
+
+  if (mode_ == ledmode::pattern && --step_ticks_ == 0) next_step();
+
+  if (flashing && --flash_ticks_ == 0) {
+    switch (mode_)
+    {
+      case ledmode::off:
+        set(false);
         break;
-      }
+
+      case ledmode::on:
+        set(true);
+        break;
+
+      case ledmode::pattern:
+        set(pgm_read_byte(&pattern_[step_ - 1]) & k_on);
+        break;
+    }
+  }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Start the next step of the pattern, going back to the start at the end.
+// ------------------------------------------------------------------------------------------------
+void led::next_step()
+{
+  uint8_t step = pgm_read_byte(&pattern_[step_]);
+
+  if (step == 0) {
+    step_ = 0;
+    step = pgm_read_byte(&pattern_[0]);
   }
+
+  ++step_;
+  step_ticks_ = step & ~k_on;
+
+  if (!flash_ticks_) set(step & k_on);
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -92,3 +185,37 @@ void led::set(bool state)
 {
   digitalWrite(led_pin_, state);
 }
+
+// ------------------------------------------------------------------------------------------------
+// Start the timer that drives the leds.
+// Timer 2 is put in CTC mode with a prescaler of 1024 and the compare value is set so that
+// it interrupts every k_led_tick_ms. Note, this takes over pwm on pins 3 and 11.
+// ------------------------------------------------------------------------------------------------
+void led::start_timer()
+{
+  static bool started = false;
+  if (started) return;
+  started = true;
+
+#if defined(__AVR__)
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    TCCR2A = _BV(WGM21);
+    TCCR2B = _BV(CS22) | _BV(CS21) | _BV(CS20);
+    OCR2A = F_CPU / 1024 * k_led_tick_ms / 1000 - 1;
+    TCNT2 = 0;
+    TIMSK2 = _BV(OCIE2A);
+  }
+#else
+  timer2_start(k_led_tick_ms * 1000ul, tick);
+#endif
+}
+
+#if defined(__AVR__)
+// ------------------------------------------------------------------------------------------------
+// The timer 2 compare interrupt drives all the leds.
+// ------------------------------------------------------------------------------------------------
+ISR(TIMER2_COMPA_vect)
+{
+  led::tick();
+}
+#endif
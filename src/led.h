@@ -1,17 +1,30 @@
 // ------------------------------------------------------------------------------------------------
 // This is a simple class for controlling an led on one of the digital io pins.
-// An led can be turned on, off or flahsed. After creating an led instance, call
-// service() from the main loop. This will ensure that flash() works smoothly.
+// An led can be turned on, off, flashed or made to play a blink pattern. The leds are
+// driven from a timer interrupt (timer 2), so there is nothing to call from the main loop.
+// All the leds share the one timer.
 // ------------------------------------------------------------------------------------------------
 #pragma once
 
 #include <Arduino.h>
 
+// The leds are updated every k_led_tick_ms milliseconds.
+constexpr uint8_t k_led_tick_ms = 10;
+
+// These are the blink patterns an led can play. The patterns repeat until another is
+// chosen, and a flash plays over the top of them.
+//    none - the led is off
+//    dtr_active - a short blink every second, Dtr is low
+//    sampling - a very short blink every 2 seconds, logging with Dtr released
+//    sensor_fault - three quick blinks and a pause
+//    overflow - two long blinks and a pause
+enum class ledpattern : uint8_t { none, dtr_active, sampling, sensor_fault, overflow };
+
 // These are the states the led can be in,
 //    off - continuously off
 //    on - continusously on
-//    flash - flash on for a period then continuously off
-enum class ledmode : uint8_t { off, on, flash };
+//    pattern - playing a blink pattern
+enum class ledmode : uint8_t { off, on, pattern };
 
 class led
 {
@@ -31,25 +44,47 @@ public:
   void off();
 
   // Flash the led for a period of time which is specified in ms.
+  // Once the flash is over the led goes back to what it was doing.
   void flash(uint16_t period_ms = 250);
 
-  // Service the led, call peridodically and ideally as fast as possible.
-  void service();
+  // Play a blink pattern, repeating until told otherwise.
+  void play(ledpattern pattern);
+
+  // Advance all the leds by one tick.
+  // This is called from the timer interrupt.
+  static void tick();
 
 private:
 
+  // Advance this led by one tick.
+  void update();
+
+  // Start the next step of the pattern.
+  void next_step();
+
   // Turn the led on or off.
   void set(bool state);
 
+  // Start the timer that drives the leds, if it isn't running already.
+  static void start_timer();
+
   // The pin the led is attached to.
   uint8_t led_pin_ ;
 
   // The currently selected mode for this led.
-  ledmode mode_;
+  volatile ledmode mode_;
+
+  // The pattern being played, and the step of the pattern.
+  const uint8_t* pattern_ = nullptr;
+  volatile uint8_t step_ = 0;
+
+  // Ticks left in the current step of the pattern.
+  volatile uint8_t step_ticks_ = 0;
 
-  // For a flashing led,this is how long it stays lit for.
-  uint16_t led_period_;
+  // Ticks left of the current flash, zero if not flashing.
+  volatile uint16_t flash_ticks_ = 0;
 
-  // If flashing, the start time of the flash in ms.
-  uint16_t led_start_t_;
+  // The leds are kept in a list for the timer interrupt.
+  led* next_ = nullptr;
+  static led* first_;
 };
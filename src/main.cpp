@@ -2,31 +2,35 @@
 #include <Arduino.h>
 
 #include "davis6410.h"
+#include "flightrecorder.h"
+#include "nmeaencoder.h"
+#include "pins.h"
+#include "pulseencoder.h"
+#include "sensorrecorder.h"
 #include "tx20emulator.h"
+#include "txengine.h"
+#include "windlog.h"
+#include "windoutputs.h"
 #include "led.h"
 
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
 
-// The pin the front panel led is attached to.
-// The led is flashed to show when a wind sample has been taken.
-constexpr int k_front_panel_ped_pin = 9;
-
-// The front panel led is flashed for this number of milliseconds when a sample has been taken.
+// The front panel led is flashed for this number of milliseconds when a sample has been sent.
 constexpr uint16_t k_led_sample_flash_ms = 333;
 
-// The Davis 6410 interface uses two pins.
-// The wind sensor pin is used to count pulses from the anenometer using interrupts. We muse us
-// a pin that supports interrupts. The wind direction is measured by sampling the wind vane
-// potentiometer in the 6410. An analoue pin is used to do this.
-constexpr int k_wind_sensor_pin = 2;
-constexpr int k_wind_direction_pin = A0;
+// Set to send TX20 frames with a bad checksum while the Davis 6410 has a fault.
+constexpr bool k_tx20_fault_frames = false;
 
-// The TX20  emulator uses two digital pins for Dtr and Txd which are defined here.
-// Dtr is an input and controls whether the TX20 should sample and send wind data.
-// Txd is an output and is used to send the sampled wind speed and direction.
-constexpr int k_dtr_pin = 3;
-constexpr int k_txd_pin = 4;
+// Single character commands that can be sent to the bridge over the serial port.
+//    t - dump the flight recorder, decode the output with tools/trace_decode.py
+//    r - start or stop recording a sensor trace, see sensortrace.h
+//    l - dump the wind log, decode the output with tools/windlog_decode.py
+//    o - print the cpu cost of each output
+constexpr char k_cmd_dump_trace = 't';
+constexpr char k_cmd_record_trace = 'r';
+constexpr char k_cmd_dump_log = 'l';
+constexpr char k_cmd_output_cost = 'o';
 
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
@@ -39,8 +43,44 @@ davis6410 wind_meter(k_wind_sensor_pin, k_wind_direction_pin);
 // Create the tx20 emulator for sending tx20 formatted wind data.
 tx20emulator tx20_emulator(k_dtr_pin, k_txd_pin);
 
+// Create the log that keeps the wind samples taken while the station has Dtr released.
+windlog wind_log(&wind_meter);
+
+// Create the extra outputs, which are sent for every sample the wind meter takes.
+nmeaencoder nmea_output(k_nmea_pin);
+pulseencoder pulse_output(k_pulse_out_pin, k_wind_speed_sample_t * 1000);
+windoutputs wind_outputs(&wind_meter);
+
 // Create the controller for the front panel led.
-led panel_led(k_front_panel_ped_pin);
+led panel_led(k_front_panel_led_pin);
+
+// The pattern the front panel led is playing.
+ledpattern panel_led_pattern = ledpattern::none;
+
+// ------------------------------------------------------------------------------------------------
+// Choose the front panel led pattern from the state of the bridge.
+// A fault with the 6410 takes priority, then a pulse counter overflow.
+// ------------------------------------------------------------------------------------------------
+ledpattern choose_panel_led_pattern() {
+  if (wind_meter.get_health()) return ledpattern::sensor_fault;
+  if (wind_meter.pulse_overflow()) return ledpattern::overflow;
+  if (tx20_emulator.state() != tx20state::disabled) return ledpattern::dtr_active;
+
+  return ledpattern::sampling;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Play the front panel led pattern if it has changed.
+// This is called on every pass of the main loop, so the led follows Dtr as soon as the
+// emulator sees it and a fault as soon as the sample that found it is taken.
+// ------------------------------------------------------------------------------------------------
+void update_panel_led() {
+  const ledpattern pattern = choose_panel_led_pattern();
+  if (pattern == panel_led_pattern) return;
+
+  panel_led_pattern = pattern;
+  panel_led.play(pattern);
+}
 
 // ------------------------------------------------------------------------------------------------
 // This is the event handler for the tx20 emulator events.
@@ -58,6 +98,9 @@ void tx20_event_handler(tx20event event) {
       }
 
     case tx20event::end_sample: {
+        // The serial port carries the binary trace while recording.
+        if (sensor_recorder.recording()) break;
+
         // At this point, the wind has been sampled and the data sent on Txd.
         // As an example, the wind sample is logged to the console.
         uint8_t pulses = wind_meter.get_pulses();
@@ -66,20 +109,57 @@ void tx20_event_handler(tx20event event) {
 
         Serial.print(String(F("pulses=")) + String(pulses));
         Serial.print(String(F(", mph=")) + String(mph));
-        Serial.println(String(F(", direction=")) + String(direction));
+        Serial.print(String(F(", direction=")) + String(direction));
+        Serial.print(String(F(", health=")) + String(wind_meter.get_health(), HEX));
+        Serial.println(String(F(", cadence=")) + String(tx20_emulator.cadence_error()) + F(" us"));
 
         break;
       }
 
     // Don't bother do anything for these events.
+    case tx20event::abort_sample:
     case tx20event::start_sample:
-    case tx20event::end_data_frame:
-    case tx20event::abort_sample: {
+    case tx20event::end_data_frame: {
       break;
     }
   }
 }
 
+// ------------------------------------------------------------------------------------------------
+// Handle any commands received on the serial port.
+// ------------------------------------------------------------------------------------------------
+void service_commands() {
+  if (!Serial.available()) return;
+
+  switch (Serial.read()) {
+    case k_cmd_dump_trace: {
+        if (!sensor_recorder.recording()) flight_recorder.dump(Serial);
+        break;
+      }
+
+    case k_cmd_dump_log: {
+        if (!sensor_recorder.recording()) wind_log.dump(Serial);
+        break;
+      }
+
+    case k_cmd_output_cost: {
+        if (!sensor_recorder.recording()) {
+          tx_engine.report(Serial, tx20_emulator.encoder());
+          wind_outputs.report(Serial);
+        }
+        break;
+      }
+
+    case k_cmd_record_trace: {
+        if (sensor_recorder.recording())
+          sensor_recorder.stop();
+        else
+          sensor_recorder.start(Serial, k_wind_direction_pin, k_dtr_pin);
+        break;
+      }
+  }
+}
+
 // ------------------------------------------------------------------------------------------------
 // Set up initaialse the 6410 interface and tx20 emulator.
 // ------------------------------------------------------------------------------------------------
@@ -99,17 +179,34 @@ void setup() {
   // panel_led.off();
 
   // The 6410 interface  and tx20 emulator must be initialised before use.
+  // The wind direction is weighted by wind run, ie the vane is read on every pulse, and the
+  // wind speed is interpolated from the pulse times.
   wind_meter.initialise();
+  wind_meter.set_direction_mode(davis6410direction::run_weighted);
+  wind_meter.set_speed_mode(davis6410speed::interpolated);
   tx20_emulator.initialise(&wind_meter, tx20_event_handler);
+  tx20_emulator.set_fault_frames(k_tx20_fault_frames);
+  wind_log.initialise();
+  wind_outputs.add(&nmea_output);
+  wind_outputs.add(&pulse_output);
+
+  update_panel_led();
 }
 
 // ------------------------------------------------------------------------------------------------
-// The main loop simply services the  6410 interface, the tx20 emulator and the led.
+// The main loop simply services the  6410 interface and the tx20 emulator.
+// The led looks after itself from a timer interrupt.
 // These need to be done periodically and as often as possible.
 // ------------------------------------------------------------------------------------------------
 void loop() {
   // Service the 6410 interface and tx20 emulator.
   wind_meter.service();
   tx20_emulator.service();
-  panel_led.service();
+  wind_log.service(tx20_emulator.state() == tx20state::disabled);
+  wind_outputs.service();
+  sensor_recorder.service();
+
+  update_panel_led();
+
+  service_commands();
 }
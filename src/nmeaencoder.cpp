@@ -0,0 +1,123 @@
+// ------------------------------------------------------------------------------------------------
+// The NMEA 0183 output.
+// ------------------------------------------------------------------------------------------------
+#include "nmeaencoder.h"
+
+#include <Arduino.h>
+
+#include "tx20emulator.h"
+
+// The checksum of an NMEA sentence is the xor of the characters between the $ and the *.
+constexpr uint8_t nmea_checksum(const char* s, uint8_t sum = 0) {
+  return *s ? nmea_checksum(s + 1, sum ^ static_cast<uint8_t>(*s)) : sum;
+}
+
+// The fixed parts of the sentence. As the checksum is an xor, the fixed characters can be
+// summed at compile time and only the numbers, reference and status added in when the
+// sentence is built.
+constexpr char k_mwv_talker[] = "WIMWV,";
+constexpr char k_mwv_separator[] = ",";
+constexpr char k_mwv_units[] = ",M,";
+// The separators either side of the reference cancel out.
+constexpr uint8_t k_mwv_checksum = nmea_checksum(k_mwv_talker) ^ nmea_checksum(k_mwv_units);
+
+static const char k_hex[] = "0123456789ABCDEF";
+
+// ------------------------------------------------------------------------------------------------
+// Append a value in tenths as a decimal with one place, with at least digits before the
+// point, and add the characters to the checksum.
+// ------------------------------------------------------------------------------------------------
+static char* put_tenths(char* p, uint16_t tenths, uint8_t digits, uint8_t& sum) {
+  char buf[6];
+  uint8_t n = 0;
+
+  buf[n++] = '0' + tenths % 10;
+  buf[n++] = '.';
+  tenths /= 10;
+
+  do {
+    buf[n++] = '0' + tenths % 10;
+    tenths /= 10;
+  } while (tenths || n < digits + 2);
+
+  while (n) {
+    *p = buf[--n];
+    sum ^= *p++;
+  }
+
+  return p;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Append a string that is already in the checksum.
+// ------------------------------------------------------------------------------------------------
+static char* put_fixed(char* p, const char* s) {
+  while (*s) *p++ = *s++;
+  return p;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Constructor sets up the pin.
+// ------------------------------------------------------------------------------------------------
+nmeaencoder::nmeaencoder(uint8_t pin, nmeareference reference)
+  : windencoder(pin), reference_{ static_cast<char>(reference) } {
+  pinMode(pin, OUTPUT);
+  digitalWrite(pin, HIGH);
+
+  sentence_[0] = '\0';
+}
+
+// ------------------------------------------------------------------------------------------------
+// Build the sentence.
+// The angle is the bearing rather than the compass point, and the speed uses the TX20 units
+// of 0.1 m/s so that the two outputs always agree.
+// ------------------------------------------------------------------------------------------------
+void nmeaencoder::encode(float mph, int, uint16_t bearing, bool valid) {
+  const char status = valid ? 'A' : 'V';
+  uint8_t sum = k_mwv_checksum ^ reference_ ^ status;
+
+  char* p = sentence_;
+  *p++ = '$';
+  p = put_fixed(p, k_mwv_talker);
+  p = put_tenths(p, bearing % 3600, 3, sum);
+  p = put_fixed(p, k_mwv_separator);
+  *p++ = reference_;
+  p = put_fixed(p, k_mwv_separator);
+  p = put_tenths(p, mph_to_tx20_units(mph), 1, sum);
+  p = put_fixed(p, k_mwv_units);
+  *p++ = status;
+  *p++ = '*';
+  *p++ = k_hex[sum >> 4];
+  *p++ = k_hex[sum & 0xf];
+  *p++ = '\r';
+  *p++ = '\n';
+  *p = '\0';
+
+  length_ = p - sentence_;
+  char_ = 0;
+  bit_ = 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Return the next run of serial bits with the same level.
+// Sending runs rather than single bits saves interrupts, eg the last data bit of a
+// character often runs into the stop bit.
+// ------------------------------------------------------------------------------------------------
+bool nmeaencoder::next_segment(bool& level, uint32_t& length) {
+  if (char_ >= length_) return false;
+
+  level = serial_bit(sentence_[char_], bit_);
+  uint8_t count = 0;
+
+  while (char_ < length_ && serial_bit(sentence_[char_], bit_) == level) {
+    ++count;
+    if (++bit_ == 10) {
+      bit_ = 0;
+      ++char_;
+    }
+  }
+
+  length = count * k_nmea_bit_length;
+
+  return true;
+}
@@ -0,0 +1,66 @@
+// ------------------------------------------------------------------------------------------------
+// The NMEA 0183 output.
+//
+// Encodes a wind sample as an MWV sentence and sends it as 4800 baud serial on a digital
+// pin, eg
+//    $WIMWV,157.5,T,4.9,M,A*2D
+// The angle is in degrees from north at the wind meter's full resolution, 1.5 degrees for
+// the 6410, the speed is in m/s and the status is V instead of A when the wind meter has a
+// sensor fault. A fixed mast gives the true wind, so the reference is T unless the
+// encoder is told the angle is relative to a vessel's bow. The pin gives TTL levels which are idle high, so
+// an RS-232 or RS-422 driver is needed to connect to most loggers.
+// ------------------------------------------------------------------------------------------------
+#pragma once
+
+#include "windencoder.h"
+
+// The serial bit length in microseconds, 4800 baud.
+constexpr uint32_t k_nmea_bit_length = 1000000UL / 4800;
+
+// The reference of the MWV angle.
+//    relative - relative to the bow of a vessel
+//    theoretical - the true wind, relative to north
+enum class nmeareference : char {
+  relative = 'R',
+  theoretical = 'T'
+};
+
+// Room for the longest sentence.
+constexpr uint8_t k_nmea_sentence_size = 32;
+
+class nmeaencoder : public windencoder
+{
+
+public:
+
+  // The pin is set up as an output and idles high.
+  explicit nmeaencoder(uint8_t pin, nmeareference reference = nmeareference::theoretical);
+
+  const char* name() const override { return "nmea"; }
+
+  // Build the sentence.
+  void encode(float mph, int direction, uint16_t bearing, bool valid) override;
+
+  // Return the next run of serial bits with the same level.
+  bool next_segment(bool& level, uint32_t& length) override;
+
+  // Return the sentence, for debugging.
+  const char* sentence() const { return sentence_; }
+
+private:
+
+  // Return the level of bit i of the serial frame for character c, a start bit, 8 data
+  // bits least significant first and a stop bit.
+  static bool serial_bit(char c, uint8_t i) { return i == 0 ? false : i == 9 ? true : (c >> (i - 1)) & 1; }
+
+  // The reference field of the sentence.
+  const char reference_;
+
+  // The sentence and its length.
+  char sentence_[k_nmea_sentence_size];
+  uint8_t length_ = 0;
+
+  // The character and bit to send next.
+  uint8_t char_ = 0;
+  uint8_t bit_ = 0;
+};
@@ -0,0 +1,33 @@
+// ------------------------------------------------------------------------------------------------
+// The pins used by the bridge.
+//
+// The sketch and the host tools that run the bridge classes on the simulated Arduino all
+// take their pins from here, so they can't drift apart.
+// ------------------------------------------------------------------------------------------------
+#pragma once
+
+#include <Arduino.h>
+
+// The pin the front panel led is attached to.
+// The led plays a pattern showing what the bridge is doing, and is flashed to show when a
+// wind sample has been sent.
+constexpr int k_front_panel_led_pin = 9;
+
+// The Davis 6410 interface uses two pins.
+// The wind sensor pin is used to count pulses from the anenometer using interrupts. We muse us
+// a pin that supports interrupts. The wind direction is measured by sampling the wind vane
+// potentiometer in the 6410. An analoue pin is used to do this.
+constexpr int k_wind_sensor_pin = 2;
+constexpr int k_wind_direction_pin = A0;
+
+// The TX20  emulator uses two digital pins for Dtr and Txd which are defined here.
+// Dtr is an input and controls whether the TX20 should sample and send wind data.
+// Txd is an output and is used to send the sampled wind speed and direction.
+constexpr int k_dtr_pin = 3;
+constexpr int k_txd_pin = 4;
+
+// The extra outputs are sent on these pins alongside the TX20.
+// The NMEA pin sends an MWV sentence for each sample at 4800 baud, and the pulse pin
+// regenerates the Davis 6410 anemometer pulses.
+constexpr int k_nmea_pin = 5;
+constexpr int k_pulse_out_pin = 6;
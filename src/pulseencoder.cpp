@@ -0,0 +1,55 @@
+// ------------------------------------------------------------------------------------------------
+// The Davis style pulse output.
+// ------------------------------------------------------------------------------------------------
+#include "pulseencoder.h"
+
+#include <Arduino.h>
+#include <util/atomic.h>
+
+// ------------------------------------------------------------------------------------------------
+// Constructor sets up the pin.
+// ------------------------------------------------------------------------------------------------
+pulseencoder::pulseencoder(uint8_t pin, uint32_t mph_period)
+  : windencoder(pin), mph_period_{ mph_period } {
+  pinMode(pin, OUTPUT);
+  digitalWrite(pin, HIGH);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Set the pulse rate from the speed.
+// The new rate is picked up at the next pulse, so the pulse in progress is not cut short.
+// ------------------------------------------------------------------------------------------------
+void pulseencoder::encode(float mph, int, uint16_t, bool) {
+  const uint32_t period = mph >= 0.1f ? static_cast<uint32_t>(mph_period_ / mph) : 0;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    period_ = period;
+  }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Return the next half of a pulse.
+// ------------------------------------------------------------------------------------------------
+bool pulseencoder::next_segment(bool& level, uint32_t& length) {
+  const uint32_t period = period_;
+
+  if (low_) {
+    // The rest of the period is high.
+    low_ = false;
+    level = true;
+    length = period > width_ ? period - width_ : width_;
+  }
+  else if (period) {
+    low_ = true;
+    width_ = period / 2 < k_pulse_width ? period / 2 : k_pulse_width;
+    level = false;
+    length = width_;
+  }
+  else {
+    // No wind, stay high and look again later.
+    level = true;
+    length = k_pulse_calm_check;
+  }
+
+  return true;
+}
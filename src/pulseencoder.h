@@ -0,0 +1,54 @@
+// ------------------------------------------------------------------------------------------------
+// The Davis style pulse output.
+//
+// Regenerates the anemometer signal of a Davis 6410 from the wind samples, so that a
+// second station or logger can count pulses just as if it were wired to the cups. The pin
+// idles high and is taken low for each pulse, like the reed switch pulling the line to
+// ground. The pulse rate is the speed of the last sample, for a 6410 one pulse per 2.25 s
+// per mph.
+// ------------------------------------------------------------------------------------------------
+#pragma once
+
+#include "windencoder.h"
+
+// How long each pulse holds the line low in microseconds.
+// The pulse is shortened in strong winds so that the line is low for half the time at most.
+constexpr uint32_t k_pulse_width = 5000;
+
+// While there is no wind the output checks for a new speed this often in microseconds.
+constexpr uint32_t k_pulse_calm_check = 250000;
+
+class pulseencoder : public windencoder
+{
+
+public:
+
+  // The pin is set up as an output and idles high.
+  // mph_period is the time from one pulse to the next at 1 mph in microseconds.
+  pulseencoder(uint8_t pin, uint32_t mph_period);
+
+  const char* name() const override { return "pulse"; }
+
+  // Set the pulse rate from the speed.
+  void encode(float mph, int direction, uint16_t bearing, bool valid) override;
+
+  // Return the next half of a pulse.
+  bool next_segment(bool& level, uint32_t& length) override;
+
+  // The pulses run all the time.
+  bool continuous() const override { return true; }
+
+private:
+
+  // The time from one pulse to the next at 1 mph in microseconds.
+  const uint32_t mph_period_;
+
+  // The time from one pulse to the next in microseconds, 0 if there is no wind.
+  volatile uint32_t period_ = 0;
+
+  // True if the pulse is low, ie the next segment is the high part.
+  bool low_ = false;
+
+  // The length of the low part of the current pulse.
+  uint32_t width_ = 0;
+};
@@ -0,0 +1,72 @@
+// ------------------------------------------------------------------------------------------------
+// A health monitor for the Davis 6410.
+// ------------------------------------------------------------------------------------------------
+#include "sensorhealth.h"
+
+// ------------------------------------------------------------------------------------------------
+// Count samples in a row for which a condition holds, saturating at the limit.
+// Returns true once the limit has been reached.
+// ------------------------------------------------------------------------------------------------
+static bool count_run(uint8_t& count, bool condition, uint8_t limit) {
+  if (!condition)
+    count = 0;
+  else if (count < limit)
+    ++count;
+
+  return count >= limit;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Hold a fault for a number of samples after it was last seen.
+// Returns true while the fault is held.
+// ------------------------------------------------------------------------------------------------
+static bool hold(uint8_t& count, bool condition) {
+  if (condition)
+    count = k_health_hold_samples;
+  else if (count)
+    --count;
+
+  return count != 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Update the monitor with the readings for a sample.
+// ------------------------------------------------------------------------------------------------
+void sensorhealth::update(uint8_t pulses, uint8_t rejects, uint8_t glitches, uint16_t adc, int degrees) {
+  uint8_t faults = sensor_ok;
+
+  // Only windy samples count towards a rail fault, in a calm the vane can rest anywhere.
+  if (pulses >= k_health_rail_min_pulses) {
+    count_run(rail_low_count_, adc < k_health_rail_margin, k_health_rail_samples);
+    count_run(rail_high_count_, adc > 1023 - k_health_rail_margin, k_health_rail_samples);
+  }
+
+  if (rail_low_count_ >= k_health_rail_samples) faults |= sensor_vane_rail_low;
+  if (rail_high_count_ >= k_health_rail_samples) faults |= sensor_vane_rail_high;
+
+  // The vane movement is measured the short way round.
+  int moved = 0;
+  if (last_degrees_ >= 0) {
+    moved = abs(degrees - last_degrees_);
+    if (moved > 180) moved = 360 - moved;
+  }
+  last_degrees_ = degrees;
+
+  // Any pulse or a still vane clears the seized count.
+  if (count_run(seized_count_, !pulses && moved >= k_health_vane_moved, k_health_seized_samples))
+    faults |= sensor_cups_seized;
+
+  const uint16_t edges = pulses + rejects;
+  const bool glitching = glitches >= k_health_glitch_min_edges &&
+                         glitches * 100u > edges * static_cast<uint16_t>(k_health_glitch_percent);
+
+  if (hold(glitch_hold_, glitching))
+    faults |= sensor_pulse_glitch;
+  const bool bouncing = edges >= k_health_bounce_min_edges &&
+                        rejects * 100u > edges * static_cast<uint16_t>(k_health_bounce_percent);
+
+  if (hold(bounce_hold_, bouncing))
+    faults |= sensor_pulse_bounce;
+
+  faults_ = faults;
+}
@@ -0,0 +1,94 @@
+// ------------------------------------------------------------------------------------------------
+// A health monitor for the Davis 6410.
+//
+// The monitor is updated once at the end of each sample with the readings for that sample,
+// and the work it does per update is fixed. It looks for,
+//    vane_rail_low / vane_rail_high - the vane adc is stuck at a rail while there is wind,
+//                                     ie the pot is shorted or open circuit
+//    cups_seized - there are no pulses but the vane keeps moving
+//    pulse_glitch - many edges closer together than the cups can physically turn, ie
+//                   interference on the cable
+//    pulse_bounce - a high proportion of the pulses are rejected by the debounce
+// ------------------------------------------------------------------------------------------------
+#pragma once
+
+#include <Arduino.h>
+
+// The faults reported by the health monitor, several may be set at once.
+enum sensorfault : uint8_t {
+  sensor_ok = 0,
+  sensor_vane_rail_low = 0x01,
+  sensor_vane_rail_high = 0x02,
+  sensor_cups_seized = 0x04,
+  sensor_pulse_glitch = 0x08,
+  sensor_pulse_bounce = 0x10,
+};
+
+// Vane readings within this many counts of a rail are taken to be stuck at the rail.
+constexpr uint16_t k_health_rail_margin = 3;
+
+// The number of samples at a rail while there is wind before the vane is faulted, and the
+// pulses a sample needs to count as windy. Adc 0 is north, so a healthy vane can sit at a
+// rail for a while, but in any wind it wanders off it within a few minutes. Calm samples
+// neither count nor reset the run.
+constexpr uint8_t k_health_rail_samples = 120;
+constexpr uint8_t k_health_rail_min_pulses = 3;
+
+// The vane must move by at least this many degrees between samples to count as moving.
+constexpr uint8_t k_health_vane_moved = 15;
+
+// The number of samples in a row with no pulses and a moving vane before the cups are
+// taken to be seized. The vane can move in wind too light to turn the cups, so this is
+// kept long, and any sample where the vane was still starts the run again.
+constexpr uint8_t k_health_seized_samples = 16;
+
+// The shortest time between pulses the cups can manage, which is 1 revolution per
+// 11.25 ms at 200 mph.
+constexpr unsigned long k_health_min_pulse_interval = 11;
+
+// The glitch rate in percent of all the edges above which the pulses are faulted, and the
+// least number of glitches in a sample to count. The odd bounce is normal for a reed
+// switch and is what the debounce is for.
+constexpr uint8_t k_health_glitch_percent = 25;
+constexpr uint8_t k_health_glitch_min_edges = 4;
+
+// The debounce reject rate in percent above which the pulses are faulted, and the least
+// number of edges in a sample for the rate to mean anything.
+constexpr uint8_t k_health_bounce_percent = 25;
+constexpr uint8_t k_health_bounce_min_edges = 4;
+
+// Glitch and bounce faults are held for this many samples after they were last seen.
+constexpr uint8_t k_health_hold_samples = 8;
+
+class sensorhealth {
+
+public:
+
+  // Update the monitor with the readings for a sample.
+  //    pulses - the debounced pulse count
+  //    rejects - the pulses rejected by the debounce
+  //    glitches - the edges closer together than k_health_min_pulse_interval
+  //    adc - the raw vane reading
+  //    degrees - the vane direction in degrees
+  void update(uint8_t pulses, uint8_t rejects, uint8_t glitches, uint16_t adc, int degrees);
+
+  // Return the faults found, a combination of sensorfault.
+  uint8_t faults() const { return faults_; }
+
+private:
+
+  // The current faults.
+  uint8_t faults_ = sensor_ok;
+
+  // Counts of samples for the rail and seized checks.
+  uint8_t rail_low_count_ = 0;
+  uint8_t rail_high_count_ = 0;
+  uint8_t seized_count_ = 0;
+
+  // Samples left before the glitch and bounce faults clear.
+  uint8_t glitch_hold_ = 0;
+  uint8_t bounce_hold_ = 0;
+
+  // The vane direction in the previous sample, -1 if there isn't one.
+  int last_degrees_ = -1;
+};
@@ -0,0 +1,104 @@
+// ------------------------------------------------------------------------------------------------
+// Records the raw sensor inputs of the bridge as a sensor trace.
+//
+// The anemometer isr only queues the edge time, the records are encoded and written out
+// from service(). Records are always written in time order, so an edge that arrives
+// after service() has read the time is left queued until the next call.
+// ------------------------------------------------------------------------------------------------
+#include "sensorrecorder.h"
+
+#include <util/atomic.h>
+
+sensorrecorder sensor_recorder;
+
+// ------------------------------------------------------------------------------------------------
+// Start recording.
+// ------------------------------------------------------------------------------------------------
+void sensorrecorder::start(Print& out, int wind_vane_pin, int dtr_pin) {
+  wind_vane_pin_ = wind_vane_pin;
+  dtr_pin_ = dtr_pin;
+
+  for (char c : k_sensor_trace_magic) out.write(c);
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    edge_head_ = edge_tail_ = 0;
+    dropped_ = 0;
+  }
+
+  out_ = &out;
+  last_t_ = micros();
+  vane_t_ = millis();
+
+  // The trace always starts with the state of Dtr and the vane.
+  dtr_level_ = digitalRead(dtr_pin_);
+  write(last_t_, dtr_level_ ? sensortracetype::dtr_high : sensortracetype::dtr_low);
+  write(last_t_, sensortracetype::vane, analogRead(wind_vane_pin_));
+}
+
+// ------------------------------------------------------------------------------------------------
+// Stop recording.
+// ------------------------------------------------------------------------------------------------
+void sensorrecorder::stop() {
+  out_ = nullptr;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Queue an anemometer edge.
+// If the queue is full the edge is dropped and counted.
+// ------------------------------------------------------------------------------------------------
+void sensorrecorder::record_edge(uint32_t t) {
+  uint8_t next = edge_head_ + 1;
+  if (next == k_sensor_trace_edge_count) next = 0;
+
+  if (next == edge_tail_) {
+    ++dropped_;
+    return;
+  }
+
+  edges_[edge_head_] = t;
+  edge_head_ = next;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Write out the queued edges and then the vane and Dtr if they are due.
+// ------------------------------------------------------------------------------------------------
+void sensorrecorder::service() {
+  if (!out_) return;
+
+  const uint32_t now = micros();
+
+  // Write the edges that happened before now.
+  while (edge_tail_ != edge_head_) {
+    uint32_t t;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { t = edges_[edge_tail_]; }
+
+    if (static_cast<int32_t>(t - now) > 0) break;
+
+    write(t, sensortracetype::pulse);
+
+    uint8_t next = edge_tail_ + 1;
+    edge_tail_ = next == k_sensor_trace_edge_count ? 0 : next;
+  }
+
+  const bool dtr = digitalRead(dtr_pin_);
+  if (dtr != dtr_level_) {
+    dtr_level_ = dtr;
+    write(now, dtr ? sensortracetype::dtr_high : sensortracetype::dtr_low);
+  }
+
+  if (millis() - vane_t_ >= k_sensor_trace_vane_interval) {
+    vane_t_ += k_sensor_trace_vane_interval;
+    write(now, sensortracetype::vane, analogRead(wind_vane_pin_));
+  }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Encode and write a single record.
+// ------------------------------------------------------------------------------------------------
+void sensorrecorder::write(uint32_t t, sensortracetype type, uint16_t value) {
+  uint8_t buf[k_sensor_trace_max_record];
+  const uint8_t n = sensor_trace_put_record(buf, t - last_t_, type, value);
+
+  out_->write(buf, n);
+  last_t_ = t;
+}
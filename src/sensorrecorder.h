@@ -0,0 +1,77 @@
+// ------------------------------------------------------------------------------------------------
+// Records the raw sensor inputs of the bridge as a sensor trace.
+//
+// While recording, every falling edge on the anemometer input is timestamped in the isr,
+// the wind vane is read every k_sensor_trace_vane_interval ms and the Dtr line is
+// watched for edges. The records are streamed out in the format described in
+// sensortrace.h so they can be replayed on the host.
+// ------------------------------------------------------------------------------------------------
+#pragma once
+
+#include <Arduino.h>
+
+#include "sensortrace.h"
+
+// How often in milliseconds the wind vane is read while recording.
+constexpr unsigned long k_sensor_trace_vane_interval = 100;
+
+// The number of anemometer edges that can be queued between calls to service().
+constexpr uint8_t k_sensor_trace_edge_count = 16;
+
+class sensorrecorder {
+
+public:
+
+  // Start recording to out.
+  // The trace header is written along with the initial state of the vane and Dtr.
+  void start(Print& out, int wind_vane_pin, int dtr_pin);
+
+  // Stop recording.
+  void stop();
+
+  // Return true if a recording is in progress.
+  bool recording() const { return out_ != nullptr; }
+
+  // Queue the time in microseconds of an anemometer edge.
+  // This is called from the anemometer isr.
+  void record_edge(uint32_t t);
+
+  // Write any queued records, read the vane and check Dtr.
+  // Call this from the main loop as often as possible.
+  void service();
+
+  // Return the number of edges lost because the queue was full.
+  uint16_t dropped() const { return dropped_; }
+
+private:
+
+  // Write a single record to the output.
+  void write(uint32_t t, sensortracetype type, uint16_t value = 0);
+
+  // The recording is written here.
+  Print* out_ = nullptr;
+
+  // The pins being recorded.
+  int wind_vane_pin_ = 0;
+  int dtr_pin_ = 0;
+
+  // The time in microseconds of the last record written.
+  uint32_t last_t_ = 0;
+
+  // The time in milliseconds the vane was last read.
+  uint32_t vane_t_ = 0;
+
+  // The last level seen on Dtr.
+  bool dtr_level_ = true;
+
+  // The queue of edge times filled by the isr.
+  volatile uint32_t edges_[k_sensor_trace_edge_count];
+  volatile uint8_t edge_head_ = 0;
+  volatile uint8_t edge_tail_ = 0;
+
+  // The number of edges lost because the queue was full.
+  volatile uint16_t dropped_ = 0;
+};
+
+// There is only the one sensor recorder, the anemometer isr feeds it directly.
+extern sensorrecorder sensor_recorder;
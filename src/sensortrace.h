@@ -0,0 +1,64 @@
+// ------------------------------------------------------------------------------------------------
+// The format of recorded sensor traces.
+//
+// A sensor trace is a stream of the raw inputs to the bridge, the anemometer edges, the
+// wind vane adc readings and the Dtr edges. Traces are written by sensorrecorder on the
+// bridge and replayed on the host through the unmodified davis6410 and tx20emulator code.
+//
+// The stream starts with the 4 byte magic "W6T1" and is followed by records. Each record
+// starts with a varint holding (delta << 2) | type, where delta is the time in
+// microseconds since the previous record. Vane records are followed by a second varint
+// holding the adc value. Varints are 7 bits per byte, least significant first, with the
+// top bit set on all but the last byte. A typical record is 2 to 5 bytes.
+// ------------------------------------------------------------------------------------------------
+#pragma once
+
+#include <stdint.h>
+
+// The magic bytes at the start of every trace.
+constexpr char k_sensor_trace_magic[4] = { 'W', '6', 'T', '1' };
+
+// These are the types of record in a sensor trace.
+//    pulse - a falling edge on the anemometer input
+//    vane - an adc reading of the wind vane
+//    dtr_low - Dtr was taken low
+//    dtr_high - Dtr was released
+enum class sensortracetype : uint8_t {
+  pulse = 0,
+  vane = 1,
+  dtr_low = 2,
+  dtr_high = 3
+};
+
+// The maximum size of an encoded record, a 5 byte delta plus a 2 byte adc value.
+constexpr uint8_t k_sensor_trace_max_record = 7;
+
+// ------------------------------------------------------------------------------------------------
+// Encode a varint into buf and return the number of bytes used.
+// ------------------------------------------------------------------------------------------------
+inline uint8_t sensor_trace_put_varint(uint8_t* buf, uint32_t value) {
+  uint8_t n = 0;
+
+  while (value >= 0x80) {
+    buf[n++] = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+
+  buf[n++] = static_cast<uint8_t>(value);
+
+  return n;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Encode a record into buf and return the number of bytes used.
+// Deltas are limited to 30 bits (about 18 minutes), which the recorder never exceeds
+// because it samples the vane regularly.
+// ------------------------------------------------------------------------------------------------
+inline uint8_t sensor_trace_put_record(uint8_t* buf, uint32_t delta, sensortracetype type,
+                                       uint16_t value = 0) {
+  uint8_t n = sensor_trace_put_varint(buf, (delta << 2) | static_cast<uint8_t>(type));
+
+  if (type == sensortracetype::vane) n += sensor_trace_put_varint(buf + n, value);
+
+  return n;
+}
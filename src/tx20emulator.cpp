@@ -2,6 +2,8 @@
 #include "tx20emulator.h"
 
 #include "Arduino.h"
+#include "flightrecorder.h"
+#include "txengine.h"
 #include "windmeterintf.h"
 
 // ------------------------------------------------------------------------------------------------
@@ -11,7 +13,7 @@ const char* winddrn_to_string(int drn) {
   // This is a look up table for converting 4 bit TX20 wind direction values to
   // named compass directions.
   static const char* directions[] = { "N",  "NNE", "NE", "ENE", "E",  "ESE",
-                                     "SE", "SEE", "S",  "SSW", "SW", "WSW",
+                                     "SE", "SSE", "S",  "SSW", "SW", "WSW",
                                      "W",  "WNW", "NW", "NNW" };
 
   return drn >= 0 && drn <= 15 ? directions[drn] : "unknown";
@@ -20,11 +22,16 @@ const char* winddrn_to_string(int drn) {
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
 
+int mph_to_tx20_units(float mph) {
+  return round(mph * 1.609344 * 1000.f * 10.f / 3600.f);
+}
+
+// ------------------------------------------------------------------------------------------------
+// ------------------------------------------------------------------------------------------------
+
 // Conversion factor from seconds to microsecondss.
 constexpr float k_microseconds = 1e6;
 
-using duration = unsigned long;
-
 // This is the minimum time after Dtr is taken low for the emulator to 'wake' up
 // and start transmitting data frames.
 constexpr duration k_dtr_wakeup_interval = 1.0 * k_microseconds;
@@ -36,21 +43,11 @@ constexpr duration k_frame_interval = 2.5 * k_microseconds;
 constexpr duration k_frame_min_interval =
 k_frame_interval - 0.5 * k_microseconds;
 
-// The number of bits in a frame.
-constexpr int k_frame_bit_count = 41;
-
-// The length of a data bit in microseconds.
-constexpr duration k_frame_bit_length = 0.002 * k_microseconds;
-// constexpr duration k_frame_bit_length = 0.00122 * k_microseconds;
-
-// Frame duration in microseconds.
-constexpr duration k_frame_duration = k_frame_bit_count * k_frame_bit_length;
-
 // ------------------------------------------------------------------------------------------------
 // Constructor.
 // ------------------------------------------------------------------------------------------------
 tx20emulator::tx20emulator(int dtr_pin, int txd_pin)
-  : dtr_pin_{ dtr_pin }, txd_pin_{ txd_pin } {
+  : dtr_pin_{ dtr_pin }, txd_pin_{ txd_pin }, encoder_{ static_cast<uint8_t>(txd_pin) } {
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -85,14 +82,24 @@ void tx20emulator::initialise(windmeterintf* wind_meter, tx20eventhandler event_
 // When the tx20 is in the inactive state, it looks to see if Dtr is low. If it
 // is pulled low then it enters the wake up phase. The wake up phase is then
 // followed by the sampling and sending phases. If dtr is still low the at the
-// end of the sending phase, the emulator loops back to the wake up phase and so
+// end of the sending phase, the emulator loops back to the sampling phase and so
 // on. If Dtr goes high, the emulator enters the inactive phase.
 //
+// Frames are sent on a fixed grid of k_frame_interval. Each deadline is the previous
+// deadline plus the interval (not the time the last frame went out plus the interval),
+// so loop jitter and the sample time do not accumulate as drift. Once a sample is
+// ready the emulator waits for its slot before sending.
+//
+// The frame is sent by the transmit engine from a timer interrupt, so the main loop
+// carries on while it goes out.
+//
 // The built in led is lit while the tx20 emulator is sampling and sending.
 // ------------------------------------------------------------------------------------------------
 void tx20emulator::service() {
   if (!initialised_) return;
 
+  const duration now = micros();
+
   switch (state_) {
     case tx20state::nothing: {
         // This state should never be enetered here.
@@ -101,9 +108,24 @@ void tx20emulator::service() {
 
     case tx20state::disabled: {
         // Check if Dtr has gone low.
-        // If it has then the tx20 enters the enabled state and starts sampling.
-        if (!read_dtr()) {
-          // Start a new wind sample and when complete set the state to sending.
+        // If it has then the tx20 wakes up and then starts sampling.
+        if (!read_dtr(now)) {
+          t_ = now;
+          max_cadence_error_ = 0;
+          set_state(tx20state::waking);
+        }
+
+        break;
+      }
+
+    case tx20state::waking: {
+        // Dtr must stay low for the whole of the wake up interval.
+        if (read_dtr(now)) {
+          set_state(tx20state::disabled);
+        }
+        else if (now - t_ >= k_dtr_wakeup_interval) {
+          // The first frame slot is one frame interval after waking up.
+          next_frame_t_ = now + k_frame_interval;
           set_state(tx20state::start_sample);
         }
 
@@ -117,48 +139,46 @@ void tx20emulator::service() {
 
         set_state(tx20state::sampling);
 
-        // Start a new wind sample and when complete set the state to sending.
+        // Start a new wind sample and when complete wait for the next frame slot.
         wind_meter_->start_sample(
           [](void* context) {
             tx20emulator* self = static_cast<tx20emulator*>(context);
-            self->set_state(tx20state::sending);
+            self->set_state(tx20state::waiting);
           },
           static_cast<void*>(this));
 
         break;
       }
 
-    case tx20state::sampling: {
-        // While sampling, monitor the dtr line.
+    case tx20state::sampling:
+    case tx20state::waiting: {
+        // While sampling or waiting, monitor the dtr line.
         // If it goes high then abort the sample and enter the disabled state.
-        if (read_dtr()) {
+        if (read_dtr(now)) {
           wind_meter_->abort_sample();
           set_state(tx20state::disabled);
           raise_event(tx20event::abort_sample);
         }
+        else if (state_ == tx20state::waiting &&
+                 static_cast<int32_t>(now - next_frame_t_) >= 0) {
+          set_state(tx20state::sending);
+          start_frame();
+        }
 
         break;
       }
 
     case tx20state::sending: {
 
-        // The sending state is atomic, ie it starts and finishes in the same service call.
-
-        // Raise the start event.
-        raise_event(tx20event::start_data_frame);
-
-        // Send the tx20 data frame and then continue.
-        float mph = wind_meter_->get_wind_mph();
-        int direction = wind_meter_->get_wind_direction();
-
-        write_frame(mph, direction);
+        // Dtr is ignored until the frame has gone.
+        if (tx_engine.busy(&encoder_)) break;
 
         // Raise the end event.
         raise_event(tx20event::end_data_frame);
 
         // Check if dtr is still low, and if not disable the tx20.
         // Otherwise continue with another sample.
-        if (read_dtr())
+        if (read_dtr(now))
           set_state(tx20state::disabled);
         else
           set_state(tx20state::start_sample);
@@ -190,14 +210,16 @@ void tx20emulator::set_state(tx20state state) {
         break;
       }
 
+    case tx20state::waking:
     case tx20state::start_sample: {
         // Txd is set low.
         digitalWrite(txd_pin_, LOW);
         break;
       }
 
-    case tx20state::sampling: {
-        // Txd is set low while sampling.
+    case tx20state::sampling:
+    case tx20state::waiting: {
+        // Txd is set low while sampling and waiting for the frame slot.
         digitalWrite(txd_pin_, LOW);
         break;
       }
@@ -209,103 +231,62 @@ void tx20emulator::set_state(tx20state state) {
   }
 
   state_ = state;
+
+  flight_recorder.log(traceid::tx20_state, static_cast<uint8_t>(state));
 }
 
 // ------------------------------------------------------------------------------------------------
   // Send an event only if there is an event listener attached.
 // ------------------------------------------------------------------------------------------------
 void tx20emulator::raise_event(tx20event event) const {
+  flight_recorder.log(traceid::tx20_event, static_cast<uint8_t>(event));
+
   if (event_fn_) event_fn_(event);
 }
 
 // ------------------------------------------------------------------------------------------------
-// Write a data frame to txd.
+// Start sending a data frame on txd.
 //
-// Given a wind direction and speed, a tx20 frame is written to the txd pin.
-// The frame consists of 41 bits which include  crc check on the data.
-// The wind speed uses units of 0.1 metres per second.
+// The frame is encoded from the last wind sample and handed to the transmit engine. The
+// time the frame starts is checked against its slot, and the next slot worked out.
 // ------------------------------------------------------------------------------------------------
-void tx20emulator::write_frame(float mph, int direction) const {
-
-  // Need to convert the wind speed from mph to units of  0.1 meters per second.
-  int units = round(mph * 1.609344 * 1000.f * 10.f / 3600.f);
-
-  // The first half of the frame uses normal bits and the second uses inverted
-  // bits.
-  int windspeed1 = units;
-  int winddrn1 = direction;
-  int winddrn2 = ~winddrn1;
-  int windspeed2 = ~windspeed1;
-
-  // Calculate the checksum.
-  int checksum = winddrn1 + (windspeed1 & 0xf) + ((windspeed1 & 0xf0) >> 4) +
-    ((windspeed1 & 0xf00) >> 8);
-
-  checksum &= 0xf;
-
-  // Write the header which is 00100.
-  // Optionally, insert a bit errorin the header.
-  write_txd(LOW);
-  write_txd(LOW);
-  write_txd(HIGH);
-  write_txd(LOW);
-  write_txd(LOW);
-
-  // Write the 4 bit wind direction.
-  int data = winddrn1;
-  for (int i = 0; i < 4; ++i) {
-    write_txd(data & 0x01);
-    data = data >> 1;
-  }
+void tx20emulator::start_frame() {
 
-  // Write the 12 bit wind speed.
-  data = windspeed1;
-  for (int i = 0; i < 12; ++i) {
-    write_txd(data & 0x01);
-    data = data >> 1;
-  }
+  // Record how far off the grid this frame is.
+  const duration frame_t = micros();
+  cadence_error_ = static_cast<int32_t>(frame_t - next_frame_t_);
+  if (cadence_error_ > max_cadence_error_) max_cadence_error_ = cadence_error_;
 
-  for (int i = 0; i < 4; ++i) {
-    write_txd(checksum & 0x01);
-    checksum = checksum >> 1;
-  }
+  // Raise the start event.
+  raise_event(tx20event::start_data_frame);
 
-  // Write the 4 bit wind direction.
-  data = winddrn2;
-  for (int i = 0; i < 4; ++i) {
-    write_txd(data & 0x01);
-    data = data >> 1;
-  }
+  // Send the tx20 data frame.
+  float mph = wind_meter_->get_wind_mph();
+  int direction = wind_meter_->get_wind_direction();
 
-  // Write the 12 bit wind speed.
-  data = windspeed2;
-  for (int i = 0; i < 12; ++i) {
-    write_txd(data & 0x01);
-    data = data >> 1;
-  }
+  tx_engine.send(&encoder_, mph, direction, wind_meter_->get_wind_bearing(),
+                 !(fault_frames_ && wind_meter_->get_health()));
 
-  // That's the end of the data frame.
-  // What we do here is write a few more end bits to give whatever is reading Txd some
-  // time to decide what to do with Dtr. If Dtr is left low then another capture phase
-  // will be entered, but on the other hand if Dtr is allowed to float high then a
-  // the sampling is disabled and Txd will go high.
-  for (int i = 0; i < 10; ++i) write_txd(LOW);
+  // Move on to the next slot. If this frame was so late that the next slot would
+  // come sooner than the minimum frame interval, the grid is restarted from now.
+  next_frame_t_ += k_frame_interval;
+
+  if (cadence_error_ > static_cast<long>(k_frame_interval - k_frame_min_interval))
+    next_frame_t_ = frame_t + k_frame_interval;
 }
 
 // ------------------------------------------------------------------------------------------------
 // Read the level on the Dtr pin.
 // A low enables the tx20 and a float/high disables it.
+// Changes in the level are logged in the flight recorder.
 // ------------------------------------------------------------------------------------------------
-bool tx20emulator::read_dtr() const { return digitalRead(dtr_pin_); }
+bool tx20emulator::read_dtr(duration now) {
+  const bool dtr = digitalRead(dtr_pin_);
 
-// ------------------------------------------------------------------------------------------------
-// Write a data bit to the TxD line.
-// The data pulse lasts k_frame_bit_length microseconds... approx 1.22 ms.
-// ------------------------------------------------------------------------------------------------
-void tx20emulator::write_txd(bool data) const {
-  const duration t = micros();
-  digitalWrite(txd_pin_, !data);
+  if (dtr != dtr_level_) {
+    dtr_level_ = dtr;
+    flight_recorder.log(now, traceid::dtr_edge, dtr);
+  }
 
-  while (micros() - t < k_frame_bit_length)
-    ;
+  return dtr;
 }
@@ -10,6 +10,8 @@
 
 #include <Arduino.h>
 
+#include "tx20encoder.h"
+
 // These are the events emitted by the tx20 emulator.
 enum class tx20event {
   start_sample,
@@ -20,11 +22,16 @@ enum class tx20event {
 };
 
 // These are the states the tx20 emulator can be in.
+//    waking - Dtr has gone low and the emulator is waiting for the wake up interval
+//    waiting - the sample is ready and the emulator is waiting for the next frame slot
+//    sending - the frame is being sent by the transmit engine
 enum class tx20state {
   nothing,
   disabled,
+  waking,
   start_sample,
   sampling,
+  waiting,
   sending
 };
 
@@ -40,6 +47,9 @@ class windmeterintf;
 // Utility function to convert a wind direction value to a name string.
 const char* winddrn_to_string(int drn);
 
+// Utility function to convert a wind speed in mph to the TX20 units of 0.1 m/s.
+int mph_to_tx20_units(float mph);
+
 class tx20emulator {
 
 public:
@@ -56,6 +66,19 @@ public:
   // Return the state of the tx20 emulator.
   tx20state state() const { return state_; }
 
+  // When enabled, frames are sent with a bad checksum while the wind meter reports a
+  // sensor fault, so that the station can tell the readings are not to be trusted.
+  void set_fault_frames(bool enable) { fault_frames_ = enable; }
+
+  // Return how late in microseconds the last frame was sent compared to its slot.
+  long cadence_error() const { return cadence_error_; }
+
+  // Return the largest cadence error in microseconds seen since Dtr was last taken low.
+  long max_cadence_error() const { return max_cadence_error_; }
+
+  // Return the encoder for the TX20 frames, eg for its cost report.
+  const tx20encoder& encoder() const { return encoder_; }
+
 private:
 
   // Set the internal state of the tx20 emulator.
@@ -65,24 +88,23 @@ private:
   // Send an event only if there is an event listener attached.
   void raise_event(tx20event event) const;
 
-  // Write a data frame to Txd.
-  // See above for details on the bit layout of the frame.
-  void write_frame(float mph, int direction) const;
+  // Start sending a data frame on Txd.
+  void start_frame();
 
-  // Read the input level of Dtr.
+  // Read the input level of Dtr, now is the time of the read in microseconds.
   // A low enables the tx20 and high disables it.
-  bool read_dtr() const;
-
-  // Writes a value to TxD.
-  void write_txd(bool value) const;
+  bool read_dtr(duration now);
 
   // If the dtr pin is held low, the tx20 emulator starts sampling and sending frames.
   const int dtr_pin_;
 
   // This pin is used to send the frame over.
-  // See the .cpp file for a description of the bits tha tmake up the frame.
+  // See tx20encoder.h for a description of the bits that make up the frame.
   const int txd_pin_;
 
+  // Encodes the frames, which are sent by the transmit engine.
+  tx20encoder encoder_;
+
   // Will be true if the emulator has been initialised.
   bool initialised_ = false;
 
@@ -97,6 +119,24 @@ private:
   // The emulator is implemented as a state machine.
   tx20state state_ = tx20state::nothing;
 
+  // Send frames with a bad checksum when the wind meter has a fault.
+  bool fault_frames_ = false;
+
+  // The last level read from Dtr, used to spot edges.
+  // Dtr is pulled up so it starts off high.
+  bool dtr_level_ = true;
+
   // General purpose timer value.
   duration t_;
+
+  // The time in microseconds at which the next frame is due to be sent.
+  // Frames are scheduled on a fixed grid, so each deadline is the previous one
+  // plus the frame interval.
+  duration next_frame_t_ = 0;
+
+  // The difference between when the last frame was sent and its deadline.
+  long cadence_error_ = 0;
+
+  // The worst cadence error seen since Dtr was last taken low.
+  long max_cadence_error_ = 0;
 };
@@ -0,0 +1,70 @@
+// ------------------------------------------------------------------------------------------------
+// The TX20 output.
+// ------------------------------------------------------------------------------------------------
+#include "tx20encoder.h"
+
+#include "tx20emulator.h"
+
+// ------------------------------------------------------------------------------------------------
+// Encode a frame.
+//
+// Given a wind direction and speed, the 41 bits of the frame are worked out here, so that
+// all the interrupt has to do is play them out.
+// The wind speed uses units of 0.1 metres per second.
+// ------------------------------------------------------------------------------------------------
+void tx20encoder::encode(float mph, int direction, uint16_t, bool valid) {
+
+  // Need to convert the wind speed from mph to units of  0.1 meters per second.
+  const uint16_t speed = mph_to_tx20_units(mph) & 0xfff;
+  const uint8_t drn = direction & 0xf;
+
+  // Calculate the checksum.
+  uint8_t checksum = (drn + (speed & 0xf) + ((speed >> 4) & 0xf) + (speed >> 8)) & 0xf;
+
+  // An invalid frame has its checksum inverted.
+  if (!valid) checksum ^= 0xf;
+
+  memset(bits_, 0, sizeof(bits_));
+  uint8_t n = 0;
+
+  auto put = [&](uint16_t data, uint8_t count) {
+    for (uint8_t i = 0; i < count; ++i, ++n)
+      if (data & (1 << i)) bits_[n >> 3] |= 1 << (n & 7);
+  };
+
+  // The header is 00100, sent as 0, 0, 1, 0, 0.
+  put(0x04, 5);
+  put(drn, 4);
+  put(speed, 12);
+  put(checksum, 4);
+
+  // The second half of the frame uses inverted bits.
+  put(~drn, 4);
+  put(~speed, 12);
+
+  // The trailing bits are all 0, which bits_ already is.
+  next_ = 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Return the next run of bits with the same level.
+// Runs of equal bits are sent as one segment, which saves interrupts.
+// ------------------------------------------------------------------------------------------------
+bool tx20encoder::next_segment(bool& level, uint32_t& length) {
+  constexpr uint8_t k_bits = k_tx20_frame_bits + k_tx20_trailing_bits;
+
+  if (next_ >= k_bits) return false;
+
+  const bool value = bit(next_);
+  uint8_t count = 0;
+
+  while (next_ < k_bits && bit(next_) == value) {
+    ++next_;
+    ++count;
+  }
+
+  level = !value;
+  length = count * k_tx20_bit_length;
+
+  return true;
+}
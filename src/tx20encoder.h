@@ -0,0 +1,46 @@
+// ------------------------------------------------------------------------------------------------
+// The TX20 output.
+//
+// Encodes a wind sample as a TX20 data frame. The frame consists of 41 bits,
+//    header 00100, direction (4), speed (12), checksum (4), ~direction (4), ~speed (12)
+// with all the fields sent least significant bit first. The line is inverted, a 0 bit is
+// high and a 1 bit is low. The frame is followed by a few 0 bits to give the station time
+// to decide what to do with Dtr.
+// ------------------------------------------------------------------------------------------------
+#pragma once
+
+#include "windencoder.h"
+
+// The length of a data bit in microseconds.
+constexpr uint32_t k_tx20_bit_length = 2000;
+
+// The number of bits in a frame, and the number of trailing bits sent after it.
+constexpr uint8_t k_tx20_frame_bits = 41;
+constexpr uint8_t k_tx20_trailing_bits = 10;
+
+class tx20encoder : public windencoder
+{
+
+public:
+
+  explicit tx20encoder(uint8_t txd_pin) : windencoder(txd_pin) {}
+
+  const char* name() const override { return "tx20"; }
+
+  // Encode a frame. If valid is false the checksum is deliberately wrong.
+  void encode(float mph, int direction, uint16_t bearing, bool valid) override;
+
+  // Return the next run of bits with the same level.
+  bool next_segment(bool& level, uint32_t& length) override;
+
+private:
+
+  // Return bit i of the frame.
+  bool bit(uint8_t i) const { return bits_[i >> 3] & (1 << (i & 7)); }
+
+  // The frame bits, including the trailing bits, in the order they are sent.
+  uint8_t bits_[(k_tx20_frame_bits + k_tx20_trailing_bits + 7) / 8] = {};
+
+  // The index of the next bit to send.
+  uint8_t next_ = k_tx20_frame_bits + k_tx20_trailing_bits;
+};
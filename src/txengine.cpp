@@ -0,0 +1,302 @@
+// ------------------------------------------------------------------------------------------------
+// The transmit engine plays out the waveforms of the wind outputs.
+//
+// Timer 1 free runs with a prescaler of 8 and the output compare A interrupt is used to
+// schedule the edges. The channels keep the time to their next edge relative to the last
+// compare, so the 16 bit counter can wrap any number of times during a long segment, eg
+// the gap between pulses in a light wind. The compare is never set more than
+// k_tx_max_wait ticks ahead for the same reason.
+//
+// Note, this takes over pwm on pins 9 and 10, and can't be used with the Servo library.
+// ------------------------------------------------------------------------------------------------
+#include "txengine.h"
+
+#include <util/atomic.h>
+
+// The longest wait between compares, it must be less than the period of the counter.
+constexpr uint16_t k_tx_max_wait = 0xff00;
+
+// The shortest wait that can be set from now, so that the counter can't pass the compare
+// before it has been set.
+constexpr uint16_t k_tx_min_wait = 16;
+
+// The cost of entering and leaving the compare interrupt in cpu cycles, which the counter
+// can't see. This is the vector jump, saving and restoring the registers the call to
+// compare() can clobber and the reti, as avr-gcc builds it.
+constexpr uint16_t k_tx_isr_overhead_cycles = 80;
+#if defined(__AVR__)
+constexpr uint16_t k_tx_isr_overhead = k_tx_isr_overhead_cycles / 8;
+#else
+constexpr uint16_t k_tx_isr_overhead = 0;
+#endif
+
+txengine tx_engine;
+
+// ------------------------------------------------------------------------------------------------
+// Access to timer 1.
+// On the host the Arduino shim's timer 1 stand in counts microseconds.
+// ------------------------------------------------------------------------------------------------
+#if defined(__AVR__)
+
+static uint16_t read_counter() {
+  return TCNT1;
+}
+
+static void set_compare(uint16_t t) {
+  OCR1A = t;
+  TIFR1 = _BV(OCF1A);
+}
+
+static void start_timer() {
+  static bool configured = false;
+
+  if (!configured) {
+    TCCR1A = 0;
+    TCCR1B = _BV(CS11);
+    configured = true;
+  }
+
+  TIFR1 = _BV(OCF1A);
+  TIMSK1 |= _BV(OCIE1A);
+}
+
+static void stop_timer() {
+  TIMSK1 &= ~_BV(OCIE1A);
+}
+
+ISR(TIMER1_COMPA_vect) {
+  tx_engine.compare(OCR1A);
+}
+
+#else
+
+static uint16_t compare_t = 0;
+
+static uint16_t read_counter() {
+  return timer1_count();
+}
+
+static void timer_isr() {
+  tx_engine.compare(compare_t);
+}
+
+static void set_compare(uint16_t t) {
+  compare_t = t;
+  timer1_set_compare(t, timer_isr);
+}
+
+static void start_timer() {
+}
+
+static void stop_timer() {
+  timer1_stop();
+}
+
+#endif
+
+// ------------------------------------------------------------------------------------------------
+// Encode a sample on an output and start sending it.
+// ------------------------------------------------------------------------------------------------
+bool txengine::send(windencoder* encoder, float mph, int direction, uint16_t bearing, bool valid) {
+  const bool sending = busy(encoder);
+
+  if (sending && !encoder->continuous()) {
+    ++encoder->overruns_;
+    return false;
+  }
+
+  channel* ch = nullptr;
+  if (!sending) {
+    for (uint8_t i = 0; i < k_tx_channel_count && !ch; ++i)
+      if (!channels_[i].encoder) ch = &channels_[i];
+
+    if (!ch) {
+      ++encoder->overruns_;
+      return false;
+    }
+  }
+
+  // A continuous output is encoded while it is running, so the encoder must update what
+  // its interrupt reads atomically.
+  const uint32_t t = micros();
+  encoder->encode(mph, direction, bearing, valid);
+  encoder->encode_us_ += micros() - t;
+  ++encoder->samples_;
+
+  if (sending) return true;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    const uint16_t now = read_counter();
+
+    if (running_) {
+      catch_up(now);
+    }
+    else {
+      last_ = now;
+      running_ = true;
+      start_timer();
+    }
+
+    // The first segment starts straight away.
+    ch->encoder = encoder;
+    if (!next_segment(*ch)) ch->encoder = nullptr;
+
+    schedule(now);
+  }
+
+  return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Return true while an output is sending.
+// ------------------------------------------------------------------------------------------------
+bool txengine::busy(const windencoder* encoder) const {
+  bool found = false;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    for (uint8_t i = 0; i < k_tx_channel_count; ++i)
+      if (channels_[i].encoder == encoder) found = true;
+  }
+
+  return found;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Stop an output.
+// The timer stops at the next compare if nothing else is sending.
+// ------------------------------------------------------------------------------------------------
+void txengine::stop(const windencoder* encoder) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    for (uint8_t i = 0; i < k_tx_channel_count; ++i)
+      if (channels_[i].encoder == encoder) channels_[i].encoder = nullptr;
+  }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Print the cost of an output.
+// The times are averages per sample, encode is the main loop and isr is the interrupt.
+// ------------------------------------------------------------------------------------------------
+void txengine::report(Print& out, const windencoder& encoder) const {
+  uint32_t segments;
+  uint32_t isr_ticks;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    segments = encoder.segments_;
+    isr_ticks = encoder.isr_ticks_;
+  }
+
+  const uint16_t samples = encoder.samples_ ? encoder.samples_ : 1;
+
+  out.print(encoder.name());
+  out.print(F(" samples="));
+  out.print(encoder.samples_);
+  out.print(F(" overruns="));
+  out.print(encoder.overruns_);
+  out.print(F(" encode_us="));
+  out.print(encoder.encode_us_ / samples);
+  out.print(F(" isr_us="));
+  out.print(isr_ticks / k_tx_ticks_per_us / samples);
+  out.print(F(" segments="));
+  out.println(segments / samples);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Run the channels that are due at the compare time now.
+// The whole interrupt, including its entry and exit and the time to set the next compare,
+// is shared between the outputs that had a segment fetched.
+// ------------------------------------------------------------------------------------------------
+void txengine::compare(uint16_t now) {
+  const uint16_t t = read_counter();
+
+  windencoder* served[k_tx_channel_count];
+  const uint8_t count = catch_up(now, served);
+  schedule(now);
+
+  if (!count) return;
+
+  const uint16_t ticks = (static_cast<uint16_t>(read_counter() - t) + k_tx_isr_overhead) / count;
+  for (uint8_t i = 0; i < count; ++i) served[i]->isr_ticks_ += ticks;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Fetch the next segment for a channel and drive its pin.
+// ------------------------------------------------------------------------------------------------
+bool txengine::next_segment(channel& ch) {
+  bool level;
+  uint32_t length;
+  if (!ch.encoder->next_segment(level, length)) return false;
+
+  digitalWrite(ch.encoder->pin(), level);
+
+  ch.remaining = length * k_tx_ticks_per_us;
+  if (!ch.remaining) ch.remaining = 1;
+
+  ++ch.encoder->segments_;
+
+  return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Set the compare for the earliest channel, or stop the timer if there are none.
+// ------------------------------------------------------------------------------------------------
+void txengine::schedule(uint16_t now) {
+  uint32_t wait = k_tx_max_wait;
+  bool any = false;
+
+  for (uint8_t i = 0; i < k_tx_channel_count; ++i) {
+    const channel& ch = channels_[i];
+    if (!ch.encoder) continue;
+
+    any = true;
+    if (ch.remaining < wait) wait = ch.remaining;
+  }
+
+  if (!any) {
+    running_ = false;
+    stop_timer();
+    return;
+  }
+
+  // The counter may have moved on from now, eg while the segments were fetched. The
+  // compare must not be set for a time the counter has already passed.
+  const uint16_t since = read_counter() - now;
+  if (static_cast<uint32_t>(since) + k_tx_min_wait > wait) wait = since + k_tx_min_wait;
+
+  set_compare(now + static_cast<uint16_t>(wait));
+}
+
+// ------------------------------------------------------------------------------------------------
+// Bring the channels up to the counter value now, running any that are due.
+// A channel that is late has its next segment shortened so that the lateness doesn't add up.
+// The outputs that had a segment fetched are put in served, if it is given.
+// ------------------------------------------------------------------------------------------------
+uint8_t txengine::catch_up(uint16_t now, windencoder** served) {
+  const uint16_t elapsed = now - last_;
+  last_ = now;
+
+  uint8_t count = 0;
+
+  for (uint8_t i = 0; i < k_tx_channel_count; ++i) {
+    channel& ch = channels_[i];
+    if (!ch.encoder) continue;
+
+    if (ch.remaining > elapsed) {
+      ch.remaining -= elapsed;
+      continue;
+    }
+
+    const uint32_t late = elapsed - ch.remaining;
+
+    if (served) served[count] = ch.encoder;
+    ++count;
+
+    if (!next_segment(ch)) {
+      ch.encoder = nullptr;
+      continue;
+    }
+
+    ch.remaining = ch.remaining > late ? ch.remaining - late : 1;
+  }
+
+  return count;
+}
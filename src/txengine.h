@@ -0,0 +1,81 @@
+// ------------------------------------------------------------------------------------------------
+// The transmit engine plays out the waveforms of the wind outputs.
+//
+// All the outputs share the one engine, which runs from the timer 1 compare interrupt. Each
+// output that is sending has a channel holding the time left until its next edge. At each
+// compare the channels that are due fetch their next segment from their encoder, and the
+// compare is set for the earliest edge to come. Nothing is sent from the main loop, so
+// adding an output costs the main loop only the time to encode a sample.
+//
+// The cost of each output is kept in its encoder and can be printed with report().
+// ------------------------------------------------------------------------------------------------
+#pragma once
+
+#include <Arduino.h>
+
+#include "windencoder.h"
+
+// The number of outputs that can be sending at the same time.
+constexpr uint8_t k_tx_channel_count = 4;
+
+// Timer 1 runs with a prescaler of 8, so a tick is 1 us on an 8MHz Pro Mini.
+#if defined(__AVR__)
+constexpr uint8_t k_tx_ticks_per_us = F_CPU / 8000000UL;
+#else
+constexpr uint8_t k_tx_ticks_per_us = 1;
+#endif
+
+class txengine {
+
+public:
+
+  // Encode a sample on an output and start sending it.
+  // A continuous output that is already running carries on with the new sample.
+  // Returns false if the output is still sending the last sample, or if all the channels
+  // are in use, in which case the sample is dropped and counted as an overrun.
+  bool send(windencoder* encoder, float mph, int direction, uint16_t bearing, bool valid);
+
+  // Return true while an output is sending.
+  bool busy(const windencoder* encoder) const;
+
+  // Stop an output, the pin is left as it is.
+  void stop(const windencoder* encoder);
+
+  // Print the cost of an output on one line.
+  void report(Print& out, const windencoder& encoder) const;
+
+  // Run the channels that are due at the compare time now.
+  // This is called from the timer interrupt.
+  void compare(uint16_t now);
+
+private:
+
+  // An output that is sending, and the ticks left until its next edge.
+  struct channel {
+    windencoder* encoder;
+    uint32_t remaining;
+  };
+
+  // Fetch the next segment for a channel and drive its pin.
+  // Returns false if the waveform has finished.
+  bool next_segment(channel& ch);
+
+  // Set the compare for the earliest channel, or stop the timer if there are none.
+  void schedule(uint16_t now);
+
+  // Bring the channels up to the counter value now.
+  // Returns the number of channels that had a segment fetched.
+  uint8_t catch_up(uint16_t now, windencoder** served = nullptr);
+
+  // The channels, an empty one has no encoder.
+  channel channels_[k_tx_channel_count] = {};
+
+  // The counter value the channels' remaining times are measured from.
+  uint16_t last_ = 0;
+
+  // True while the timer interrupt is running.
+  bool running_ = false;
+};
+
+// There is only the one transmit engine which all the outputs share.
+extern txengine tx_engine;
@@ -0,0 +1,64 @@
+// ------------------------------------------------------------------------------------------------
+// This is the base class for the wind outputs.
+//
+// An encoder turns a wind sample into a waveform on a digital pin, eg a TX20 frame or an
+// NMEA sentence. The waveform is handed out as segments, each a level and how long to hold
+// it for, and these are played out by the transmit engine (see txengine.h) from a timer
+// interrupt. Encoding is done in the main loop, so next_segment() should do very little.
+//
+// If you want to add a new output, derive from this class and implement name(), encode()
+// and next_segment(), then add it to the wind outputs (see windoutputs.h).
+// ------------------------------------------------------------------------------------------------
+#pragma once
+
+#include <stdint.h>
+
+class windencoder
+{
+
+public:
+
+  explicit windencoder(uint8_t pin) : pin_{pin} {}
+  virtual ~windencoder() {}
+
+  // Return a short name for the output, used in the cost report.
+  virtual const char* name() const = 0;
+
+  // Encode a wind sample ready to be sent.
+  // direction is the compass point, 0=N, 4=E etc, and bearing is the same direction in
+  // tenths of a degree at the wind meter's full resolution.
+  // valid is false when the wind meter has a sensor fault.
+  // This is only called while the output is idle, unless the output is continuous.
+  virtual void encode(float mph, int direction, uint16_t bearing, bool valid) = 0;
+
+  // Return the next segment of the waveform, the level of the pin and how long it lasts in
+  // microseconds. Returns false when the waveform is finished.
+  // This is called from the transmit engine's interrupt.
+  virtual bool next_segment(bool& level, uint32_t& length) = 0;
+
+  // A continuous output never finishes, it picks up each new sample as it arrives.
+  virtual bool continuous() const { return false; }
+
+  // The pin the output is sent on.
+  uint8_t pin() const { return pin_; }
+
+private:
+
+  friend class txengine;
+
+  // The pin the output is sent on.
+  const uint8_t pin_;
+
+  // The cost of the output, kept by the transmit engine.
+  //    samples - the number of samples encoded
+  //    overruns - samples dropped because the last one was still being sent
+  //    encode_us - the total time spent in encode()
+  //    segments - the number of segments played out
+  //    isr_ticks - the total time in the interrupt, the output's share of each interrupt that
+  //                fetched one of its segments, entry and exit included, in timer ticks
+  uint16_t samples_ = 0;
+  uint16_t overruns_ = 0;
+  uint32_t encode_us_ = 0;
+  volatile uint32_t segments_ = 0;
+  volatile uint32_t isr_ticks_ = 0;
+};
@@ -0,0 +1,283 @@
+// ------------------------------------------------------------------------------------------------
+// A store and forward log of wind samples taken while the TX20 emulator is disabled.
+//
+// Writing a byte of EEPROM takes 3.3 ms, so pages are spilled to EEPROM one byte per call
+// to service() rather than holding up the main loop for a whole page. The pages waiting to
+// be spilled are the newest in the SRAM ring, so they need no copy of their own.
+// ------------------------------------------------------------------------------------------------
+#include "windlog.h"
+
+#include <avr/eeprom.h>
+
+#include "tx20emulator.h"
+
+// Offsets of the fields in a page.
+constexpr uint8_t k_page_sequence = 0;
+constexpr uint8_t k_page_length = 1;
+constexpr uint8_t k_page_data = 2;
+
+// The longest record, a time base of 2 bytes and a 4 byte delta.
+constexpr uint8_t k_max_record = 6;
+
+// The longest delta a sample record can hold, a 3 byte varint.
+constexpr uint32_t k_max_sample_delta = 0x1fffff;
+
+// A speed of k_control_speed marks a control record, the kind is in the direction bits.
+constexpr uint16_t k_control_speed = 0xfff;
+
+enum class windlogcontrol : uint8_t {
+  restart = 0,
+  time_base = 1,
+};
+
+// Sequence numbers run from 1 to 254, 0 and 0xff mark an unused page.
+constexpr uint8_t k_max_sequence = 254;
+
+static uint8_t next_sequence(uint8_t sequence) {
+  return sequence >= k_max_sequence ? 1 : sequence + 1;
+}
+
+static bool valid_sequence(uint8_t sequence) {
+  return sequence != 0 && sequence != 0xff;
+}
+
+// The EEPROM address of a byte in a page.
+static uint8_t* eeprom_address(uint8_t page, uint8_t offset) {
+  return reinterpret_cast<uint8_t*>(k_windlog_eeprom_base + page * k_windlog_page_size + offset);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Constructor.
+// ------------------------------------------------------------------------------------------------
+windlog::windlog(windmeterintf* wind_meter)
+  : wind_meter_{ wind_meter } {
+  page_[k_page_length] = 0;
+
+  memset(sram_pages_, 0xff, sizeof(sram_pages_));
+}
+
+// ------------------------------------------------------------------------------------------------
+// Find the end of the log in EEPROM.
+// The newest page is the one whose successor in the ring does not carry on the sequence.
+// ------------------------------------------------------------------------------------------------
+void windlog::initialise() {
+  next_page_ = 0;
+  sequence_ = 1;
+  spill_count_ = 0;
+  eeprom_slot_ = 0;
+  eeprom_offset_ = 0;
+
+  for (uint8_t page = 0; k_windlog_eeprom_spill && page < k_windlog_eeprom_pages; ++page) {
+    const uint8_t sequence = eeprom_read_byte(eeprom_address(page, k_page_sequence));
+    if (!valid_sequence(sequence)) continue;
+
+    const uint8_t next = page + 1 == k_windlog_eeprom_pages ? 0 : page + 1;
+    if (eeprom_read_byte(eeprom_address(next, k_page_sequence)) != next_sequence(sequence)) {
+      eeprom_slot_ = next;
+      sequence_ = next_sequence(sequence);
+      break;
+    }
+  }
+
+  page_[k_page_sequence] = sequence_;
+  page_[k_page_length] = 0;
+  have_last_t_ = false;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Service the log.
+// ------------------------------------------------------------------------------------------------
+void windlog::service(bool active) {
+  if (k_windlog_eeprom_spill) write_eeprom();
+
+  if (!active) {
+    resumed_ = true;
+
+    if (sampling_) {
+      wind_meter_->abort_sample();
+      sampling_ = false;
+    }
+    return;
+  }
+
+  if (sampling_ && sample_ready_) {
+    sampling_ = false;
+    append(mph_to_tx20_units(wind_meter_->get_wind_mph()), wind_meter_->get_wind_direction());
+  }
+
+  if (!sampling_) {
+    sample_ready_ = false;
+    sampling_ = wind_meter_->start_sample(
+      [](void* context) { static_cast<windlog*>(context)->sample_ready_ = true; },
+      static_cast<void*>(this));
+  }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Add a record to the current page.
+// ------------------------------------------------------------------------------------------------
+void windlog::append(uint16_t speed, uint8_t direction) {
+  const uint32_t now = millis();
+  uint32_t delta = now - last_t_;
+
+  uint8_t record[k_max_record];
+
+  // After a restart there is nothing to measure the time from. When the log resumes, or
+  // the delta is too long for a sample record, the full delta goes in a time base.
+  if (!have_last_t_ || resumed_ || delta > k_max_sample_delta) {
+    const windlogcontrol control = have_last_t_ ? windlogcontrol::time_base : windlogcontrol::restart;
+    const uint16_t value = k_control_speed | (static_cast<uint16_t>(control) << 12);
+
+    record[0] = value & 0xff;
+    record[1] = value >> 8;
+
+    if (control == windlogcontrol::time_base) {
+      for (uint8_t i = 0; i < 4; ++i) record[2 + i] = delta >> (8 * i);
+      put(record, 6);
+    }
+    else {
+      put(record, 2);
+    }
+
+    delta = 0;
+  }
+
+  last_t_ = now;
+  have_last_t_ = true;
+  resumed_ = false;
+
+  // No sample can have the control speed, it is 409 m/s.
+  if (speed >= k_control_speed) speed = k_control_speed - 1;
+
+  const uint16_t value = speed | (static_cast<uint16_t>(direction & 0xf) << 12);
+  uint8_t length = 0;
+
+  record[length++] = value & 0xff;
+  record[length++] = value >> 8;
+
+  while (delta >= 0x80) {
+    record[length++] = (delta & 0x7f) | 0x80;
+    delta >>= 7;
+  }
+  record[length++] = delta;
+
+  put(record, length);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Add a record to the current page, starting a new page if it doesn't fit.
+// ------------------------------------------------------------------------------------------------
+void windlog::put(const uint8_t* record, uint8_t length) {
+  if (page_[k_page_length] + length > k_windlog_page_size - k_page_data) store_page();
+
+  memcpy(&page_[k_page_data + page_[k_page_length]], record, length);
+  page_[k_page_length] += length;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Move the current page into the ring and start a new one.
+// With the spill on, the slot being reused may hold a page that hasn't reached the EEPROM
+// yet, in which case it is dropped rather than waiting for the EEPROM.
+// ------------------------------------------------------------------------------------------------
+void windlog::store_page() {
+  if (k_windlog_eeprom_spill) {
+    if (spill_count_ == k_windlog_sram_pages) {
+      // The next page goes in the same EEPROM slot, from the start.
+      --spill_count_;
+      eeprom_offset_ = 0;
+      ++dropped_pages_;
+    }
+
+    ++spill_count_;
+  }
+
+  memcpy(sram_pages_[next_page_], page_, k_windlog_page_size);
+
+  if (++next_page_ == k_windlog_sram_pages) next_page_ = 0;
+  sequence_ = next_sequence(sequence_);
+
+  page_[k_page_sequence] = sequence_;
+  page_[k_page_length] = 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Return the SRAM page i pages back from the newest.
+// ------------------------------------------------------------------------------------------------
+const uint8_t* windlog::sram_page(uint8_t i) const {
+  return sram_pages_[(next_page_ + k_windlog_sram_pages - i) % k_windlog_sram_pages];
+}
+
+// ------------------------------------------------------------------------------------------------
+// Write the next byte of the oldest page waiting to be spilled.
+// The sequence number is cleared first and written last, so that a half written page is
+// never taken as valid after a restart.
+// ------------------------------------------------------------------------------------------------
+void windlog::write_eeprom() {
+  if (!spill_count_ || !eeprom_is_ready()) return;
+
+  const uint8_t* page = sram_page(spill_count_);
+  uint8_t offset = eeprom_offset_;
+  uint8_t value = 0xff;
+
+  if (eeprom_offset_ == k_windlog_page_size) {
+    offset = k_page_sequence;
+    value = page[k_page_sequence];
+  }
+  else if (eeprom_offset_ != k_page_sequence) {
+    value = page[offset];
+  }
+
+  eeprom_update_byte(eeprom_address(eeprom_slot_, offset), value);
+
+  if (++eeprom_offset_ > k_windlog_page_size) {
+    eeprom_offset_ = 0;
+    if (++eeprom_slot_ == k_windlog_eeprom_pages) eeprom_slot_ = 0;
+    --spill_count_;
+  }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Write out all the pages, oldest first.
+// The EEPROM slot being written comes first, it is either the oldest page or, part way
+// through, has no sequence number and is skipped by the decoder.
+// ------------------------------------------------------------------------------------------------
+void windlog::dump(Print& out) {
+  const uint8_t eeprom_pages = k_windlog_eeprom_spill ? k_windlog_eeprom_pages : 0;
+  const uint8_t sram_pages = k_windlog_eeprom_spill ? spill_count_ : k_windlog_sram_pages;
+
+  out.print(F("windlog "));
+  out.print(eeprom_pages + sram_pages + 1);
+  out.print(' ');
+  out.print(have_last_t_ ? millis() - last_t_ : 0);
+  out.print(' ');
+  out.println(dropped_pages_);
+
+  for (uint8_t i = 0; i < eeprom_pages; ++i) {
+    const uint8_t slot = (eeprom_slot_ + i) % k_windlog_eeprom_pages;
+
+    uint8_t page[k_windlog_page_size];
+    for (uint8_t offset = 0; offset < k_windlog_page_size; ++offset)
+      page[offset] = eeprom_read_byte(eeprom_address(slot, offset));
+
+    dump_page(out, page);
+  }
+
+  for (uint8_t i = sram_pages; i > 0; --i) dump_page(out, sram_page(i));
+
+  // The last page is the one being filled.
+  dump_page(out, page_);
+
+  out.println(F("end"));
+}
+
+// ------------------------------------------------------------------------------------------------
+// Write out a page as hex.
+// ------------------------------------------------------------------------------------------------
+void windlog::dump_page(Print& out, const uint8_t* page) {
+  for (uint8_t offset = 0; offset < k_windlog_page_size; ++offset) {
+    if (page[offset] < 0x10) out.print('0');
+    out.print(page[offset], HEX);
+  }
+
+  out.println();
+}
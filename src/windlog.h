@@ -0,0 +1,127 @@
+// ------------------------------------------------------------------------------------------------
+// A store and forward log of wind samples taken while the TX20 emulator is disabled.
+//
+// When the station releases Dtr the emulator stops sampling, so without the log the wind
+// for that period would be lost. While the log is active it keeps the wind meter sampling
+// and appends a record for each sample. The log can be dumped over serial and decoded with
+// tools/windlog_decode.py to backfill the gap.
+//
+// The log is a ring of pages. Each page is a 1 byte sequence number, a 1 byte length and
+// up to 30 bytes of records. Each record starts with 2 bytes holding the speed in TX20
+// units (low 12 bits) and the direction (top 4 bits). A sample record follows this with a
+// varint of the time in ms since the previous record, up to 3 bytes. A speed of 0xfff marks
+// a control record instead, with its kind in the direction bits,
+//    restart - the bridge restarted, the records before it can't be placed in time
+//    time_base - followed by a 4 byte delta in ms since the previous record, written when
+//                the log resumes and whenever the delta is too long for a sample record
+// The sample after a control record has a delta of 0.
+//
+// Full pages go to a ring in SRAM. If k_windlog_eeprom_spill is set, each full page is also
+// copied to a larger ring in EEPROM, where the log survives a restart and goes back further.
+// The copy is written a byte per call to service(), so the main loop never waits on the
+// EEPROM, and the SRAM ring holds the pages that are still waiting. If the copy falls a
+// whole SRAM ring behind, the oldest waiting page is dropped from the EEPROM and counted.
+// The EEPROM pages are written in rotation, which spreads the wear evenly over all of them.
+// ------------------------------------------------------------------------------------------------
+#pragma once
+
+#include <Arduino.h>
+
+#include "windmeterintf.h"
+
+// Set to spill the log to EEPROM, where it survives a restart.
+// A page is written about every 16 seconds while the log is active, so with 32 pages each
+// EEPROM byte sees a write every 8.5 minutes. Leave this off unless the station only
+// releases Dtr occasionally.
+constexpr bool k_windlog_eeprom_spill = false;
+
+// The size of a log page in bytes, including the 2 byte header.
+constexpr uint8_t k_windlog_page_size = 32;
+
+// The number of pages in the SRAM ring.
+constexpr uint8_t k_windlog_sram_pages = 8;
+
+// The number of pages in the EEPROM ring and where it starts.
+constexpr uint8_t k_windlog_eeprom_pages = 32;
+constexpr int k_windlog_eeprom_base = 0;
+
+class windlog {
+
+public:
+
+  windlog(windmeterintf* wind_meter);
+
+  // Find the end of the log in EEPROM so that logging carries on from where it was.
+  // Must be done once before the log is used.
+  void initialise();
+
+  // Service the log.
+  // While active is true the wind meter is kept sampling and each sample is logged.
+  // When it goes false, any sample in progress is aborted so the wind meter is free.
+  void service(bool active);
+
+  // Write out all the pages, oldest first, as hex.
+  // The dump starts with "windlog <pages> <ms since last record> <dropped pages>" and ends
+  // with "end". With the EEPROM spill on, the EEPROM pages come first.
+  void dump(Print& out);
+
+  // Return the number of pages dropped because the EEPROM spill fell behind.
+  uint16_t dropped_pages() const { return dropped_pages_; }
+
+private:
+
+  // Add a record for the last sample.
+  void append(uint16_t speed, uint8_t direction);
+
+  // Add a record to the current page, starting a new page if it doesn't fit.
+  void put(const uint8_t* record, uint8_t length);
+
+  // Move the current page into the ring and start a new one.
+  void store_page();
+
+  // Return the SRAM page i pages back from the newest, 1 being the newest.
+  const uint8_t* sram_page(uint8_t i) const;
+
+  // Write out a byte of the oldest page waiting to be spilled if the EEPROM is ready.
+  void write_eeprom();
+
+  // Write out a page as hex.
+  static void dump_page(Print& out, const uint8_t* page);
+
+  // The wind meter being sampled.
+  windmeterintf* wind_meter_;
+
+  // True while a sample for the log is in progress.
+  bool sampling_ = false;
+
+  // True once the sample in progress has finished.
+  bool sample_ready_ = false;
+
+  // The time in ms of the last record, and whether there has been one since restart.
+  uint32_t last_t_ = 0;
+  bool have_last_t_ = false;
+
+  // True when the log has been inactive since the last record.
+  bool resumed_ = false;
+
+  // The page being filled.
+  uint8_t page_[k_windlog_page_size];
+
+  // The ring of full pages in SRAM.
+  uint8_t sram_pages_[k_windlog_sram_pages][k_windlog_page_size];
+
+  // The SRAM slot the current page will be stored in, and its sequence number.
+  uint8_t next_page_ = 0;
+  uint8_t sequence_ = 1;
+
+  // The number of SRAM pages waiting to be spilled, the oldest is being written.
+  uint8_t spill_count_ = 0;
+
+  // The EEPROM slot being written and the next byte of it to write, the page's sequence
+  // number is written last at an offset of k_windlog_page_size.
+  uint8_t eeprom_slot_ = 0;
+  uint8_t eeprom_offset_ = 0;
+
+  // The number of pages the spill has dropped.
+  uint16_t dropped_pages_ = 0;
+};
@@ -10,6 +10,8 @@
 // ------------------------------------------------------------------------------------------------
 #pragma once
 
+#include <stdint.h>
+
 // This is the callback function signature for when a sample has been taken.
 using windsamplefn = void (*)(void* context);
 
@@ -33,5 +35,18 @@ public:
   // Returns the direction as 0=N, E=4 etc.
   virtual int get_wind_direction() const = 0;
 
+  // Return the last sampled wind direction in tenths of a degree from north.
+  // Wind meters that only know the compass point return the middle of its sector.
+  virtual uint16_t get_wind_bearing() const { return (get_wind_direction() & 0xf) * 225; }
+
+  // Return any sensor faults found by the wind meter.
+  // Zero means healthy, wind meters that don't check themselves always return zero.
+  virtual uint8_t get_health() const { return 0; }
+
+  // Return the number of samples taken so far, which wraps at 256.
+  // A change in the count means there is a new sample. Wind meters that don't count
+  // their samples always return zero.
+  virtual uint8_t get_sample_count() const { return 0; }
+
 };
 
@@ -0,0 +1,50 @@
+// ------------------------------------------------------------------------------------------------
+// Fans each wind sample out to a set of outputs.
+// ------------------------------------------------------------------------------------------------
+#include "windoutputs.h"
+
+#include "txengine.h"
+
+// ------------------------------------------------------------------------------------------------
+// Constructor.
+// ------------------------------------------------------------------------------------------------
+windoutputs::windoutputs(windmeterintf* wind_meter)
+  : wind_meter_{wind_meter} {
+}
+
+// ------------------------------------------------------------------------------------------------
+// Add an output.
+// ------------------------------------------------------------------------------------------------
+bool windoutputs::add(windencoder* encoder) {
+  if (count_ == k_wind_output_count) return false;
+
+  encoders_[count_++] = encoder;
+  sample_count_ = wind_meter_->get_sample_count();
+
+  return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Send the latest sample to all the outputs.
+// An output that is still sending the last sample misses this one.
+// ------------------------------------------------------------------------------------------------
+void windoutputs::service() {
+  const uint8_t sample_count = wind_meter_->get_sample_count();
+  if (sample_count == sample_count_) return;
+
+  sample_count_ = sample_count;
+
+  const float mph = wind_meter_->get_wind_mph();
+  const int direction = wind_meter_->get_wind_direction();
+  const uint16_t bearing = wind_meter_->get_wind_bearing();
+  const bool valid = !wind_meter_->get_health();
+
+  for (uint8_t i = 0; i < count_; ++i) tx_engine.send(encoders_[i], mph, direction, bearing, valid);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Print the cost of each output.
+// ------------------------------------------------------------------------------------------------
+void windoutputs::report(Print& out) const {
+  for (uint8_t i = 0; i < count_; ++i) tx_engine.report(out, *encoders_[i]);
+}
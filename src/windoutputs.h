@@ -0,0 +1,47 @@
+// ------------------------------------------------------------------------------------------------
+// Fans each wind sample out to a set of outputs.
+//
+// The outputs are sent alongside the TX20 emulator, eg an NMEA sentence for a logger and a
+// regenerated pulse for a second station on the same mast. Every sample the wind meter
+// takes is sent, whether it was started by the emulator or by the wind log, so the outputs
+// carry on when the station releases Dtr. The outputs are played out by the transmit
+// engine (see txengine.h) and don't block the main loop.
+// ------------------------------------------------------------------------------------------------
+#pragma once
+
+#include <Arduino.h>
+
+#include "windencoder.h"
+#include "windmeterintf.h"
+
+// The largest number of outputs.
+constexpr uint8_t k_wind_output_count = 3;
+
+class windoutputs {
+
+public:
+
+  windoutputs(windmeterintf* wind_meter);
+
+  // Add an output. Returns false if there is no room for it.
+  bool add(windencoder* encoder);
+
+  // Send the latest sample to all the outputs when the wind meter has a new one.
+  // This should be called periodically.
+  void service();
+
+  // Print the cost of each output, one per line.
+  void report(Print& out) const;
+
+private:
+
+  // The wind meter the samples come from.
+  windmeterintf* wind_meter_;
+
+  // The outputs.
+  windencoder* encoders_[k_wind_output_count] = {};
+  uint8_t count_ = 0;
+
+  // The sample count when the outputs were last sent.
+  uint8_t sample_count_ = 0;
+};
@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+# ------------------------------------------------------------------------------------------------
+# Fit an anemometer calibration curve and write src/calibrationdata.h.
+#
+# The input is a csv of paired readings taken in a wind tunnel or next to a reference
+# sensor, one pair per line,
+#
+#   raw_mph,reference_mph
+#
+# where raw_mph is the bridge's uncalibrated reading (pulses * 2.25 / T). A piecewise
+# linear curve with a point every 10.24 mph is fitted by least squares. Points with no
+# data near them are pulled towards the identity so the curve stays sensible, and the
+# curve always passes through 0.
+#
+#   python tools/fit_calibration.py readings.csv > src/calibrationdata.h
+# ------------------------------------------------------------------------------------------------
+import argparse
+import csv
+import sys
+
+# These must match the firmware, see calibration.h.
+CAL_SHIFT = 10
+CAL_COUNT = 21
+STEP = 1 << CAL_SHIFT
+
+# How strongly points without data are pulled to the identity.
+REGULARISATION = 1e-3
+
+
+def read_pairs(path):
+    pairs = []
+    with open(path) as f:
+        for row in csv.reader(f):
+            try:
+                raw, ref = float(row[0]), float(row[1])
+            except (ValueError, IndexError):
+                continue
+            pairs.append((raw * 100.0, ref * 100.0))
+    return pairs
+
+
+def solve(a, b):
+    """Solve a x = b by Gaussian elimination with partial pivoting."""
+    n = len(b)
+    for col in range(n):
+        pivot = max(range(col, n), key=lambda r: abs(a[r][col]))
+        a[col], a[pivot] = a[pivot], a[col]
+        b[col], b[pivot] = b[pivot], b[col]
+        for r in range(col + 1, n):
+            f = a[r][col] / a[col][col]
+            for c in range(col, n):
+                a[r][c] -= f * a[col][c]
+            b[r] -= f * b[col]
+    x = [0.0] * n
+    for r in reversed(range(n)):
+        x[r] = (b[r] - sum(a[r][c] * x[c] for c in range(r + 1, n))) / a[r][r]
+    return x
+
+
+def fit(pairs):
+    """Least squares fit of the knot values, with knot 0 fixed at 0."""
+    n = CAL_COUNT - 1
+    a = [[0.0] * n for _ in range(n)]
+    b = [0.0] * n
+
+    for raw, ref in pairs:
+        segment = min(int(raw) >> CAL_SHIFT, CAL_COUNT - 2)
+        t = (raw - segment * STEP) / STEP
+        weights = {segment: 1.0 - t, segment + 1: t}
+        for i, wi in weights.items():
+            if i == 0:
+                continue
+            for j, wj in weights.items():
+                if j == 0:
+                    continue
+                a[i - 1][j - 1] += wi * wj
+            b[i - 1] += wi * ref
+
+    scale = max(1.0, len(pairs)) * REGULARISATION
+    for i in range(n):
+        a[i][i] += scale
+        b[i] += scale * (i + 1) * STEP
+
+    return [0.0] + solve(a, b)
+
+
+def write_header(knots, source, out):
+    values = [max(0, min(0xFFFF, int(round(k)))) for k in knots]
+
+    out.write("// " + "-" * 96 + "\n")
+    out.write("// Calibration data for this unit's Davis 6410.\n")
+    out.write("//\n")
+    out.write("// Generated by tools/fit_calibration.py from %s, do not edit by hand.\n" % source)
+    out.write("// " + "-" * 96 + "\n")
+    out.write("#pragma once\n\n#include <Arduino.h>\n\n")
+    out.write("// Anemometer calibration curve.\n")
+    out.write("// Entry i is the calibrated speed for a raw speed of i * 10.24 mph, both in units of\n")
+    out.write("// 0.01 mph.\n")
+    out.write("constexpr uint8_t k_anemometer_cal_count = %d;\n\n" % CAL_COUNT)
+    out.write("const uint16_t k_anemometer_cal[k_anemometer_cal_count] PROGMEM = {\n")
+    for i in range(0, len(values), 11):
+        out.write("  " + " ".join("%d," % v for v in values[i:i + 11]) + "\n")
+    out.write("};\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Fit a Davis 6410 anemometer calibration curve.")
+    parser.add_argument("readings", help="csv of raw_mph,reference_mph pairs")
+    args = parser.parse_args()
+
+    pairs = read_pairs(args.readings)
+    if not pairs:
+        sys.exit("fit_calibration: no readings in %s" % args.readings)
+
+    knots = fit(pairs)
+
+    if any(b < a for a, b in zip(knots, knots[1:])):
+        sys.stderr.write("fit_calibration: warning, the curve is not monotonic\n")
+
+    write_header(knots, args.readings, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
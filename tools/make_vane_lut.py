@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+# ------------------------------------------------------------------------------------------------
+# Build the wind vane lookup table and write src/vanecalibration.h.
+#
+# The table maps each 10 bit adc reading of the vane to a direction in units of 1.5
+# degrees (0 to 239), or to 0xff for readings in the pot's dead band. The north offset,
+# the dead band and any non-linearity of the pot are all baked into the table, so the
+# firmware maps a reading with a single flash read.
+#
+#   python tools/make_vane_lut.py [--north DEG] [--dead-band LO HI] [--points CSV] \
+#       > src/vanecalibration.h
+#
+#   --north      the direction the vane reads when pointing to true north, in degrees
+#   --dead-band  adc readings from LO to HI inclusive are in the dead band
+#   --points     csv of "adc,degrees" pairs measured with the vane at known directions,
+#                the pot is taken as linear between them (and across the dead band)
+# ------------------------------------------------------------------------------------------------
+import argparse
+import bisect
+import csv
+import sys
+
+ADC_COUNT = 1024
+STEPS = 240
+DEAD_BAND = 0xFF
+
+
+def read_points(path):
+    points = []
+    with open(path) as f:
+        for row in csv.reader(f):
+            try:
+                points.append((float(row[0]), float(row[1])))
+            except (ValueError, IndexError):
+                continue
+    return sorted(points)
+
+
+def adc_to_degrees(adc, points):
+    """Interpolate the pot's angle for an adc reading, wrapping round through north."""
+    if not points:
+        return adc * 360.0 / ADC_COUNT
+
+    # Extend the points by a turn either side so that interpolation wraps.
+    first, last = points[0], points[-1]
+    extended = [(last[0] - ADC_COUNT, last[1] - 360.0)] + points + [(first[0] + ADC_COUNT, first[1] + 360.0)]
+
+    # Unwrap the angles so they increase.
+    unwrapped = [extended[0]]
+    for x, d in extended[1:]:
+        while d < unwrapped[-1][1]:
+            d += 360.0
+        unwrapped.append((x, d))
+
+    xs = [x for x, _ in unwrapped]
+    i = max(1, min(len(xs) - 1, bisect.bisect_right(xs, adc)))
+    (x0, d0), (x1, d1) = unwrapped[i - 1], unwrapped[i]
+    return d0 + (d1 - d0) * (adc - x0) / (x1 - x0) if x1 != x0 else d0
+
+
+def build(north, dead_band, points):
+    table = []
+    for adc in range(ADC_COUNT):
+        if dead_band and dead_band[0] <= adc <= dead_band[1]:
+            table.append(DEAD_BAND)
+            continue
+        degrees = (adc_to_degrees(adc, points) - north) % 360.0
+        table.append(int(round(degrees * STEPS / 360.0)) % STEPS)
+    return table
+
+
+def write_header(table, description, out):
+    out.write("// " + "-" * 96 + "\n")
+    out.write("// Wind vane lookup table for this unit's Davis 6410.\n")
+    out.write("//\n")
+    out.write("// Generated by tools/make_vane_lut.py (%s), do not edit by hand.\n" % description)
+    out.write("// " + "-" * 96 + "\n")
+    out.write("#pragma once\n\n#include <Arduino.h>\n\n")
+    out.write("// Entry i is the direction for an adc reading of i in units of 1.5 degrees, or\n")
+    out.write("// k_vane_dead_band if the reading is in the pot's dead band.\n")
+    out.write("const uint8_t k_vane_lut[1024] PROGMEM = {\n")
+    for i in range(0, ADC_COUNT, 16):
+        out.write("  " + " ".join("%d," % v for v in table[i:i + 16]) + "\n")
+    out.write("};\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Build the Davis 6410 wind vane lookup table.")
+    parser.add_argument("--north", type=float, default=0.0, help="reading in degrees at true north")
+    parser.add_argument("--dead-band", type=int, nargs=2, metavar=("LO", "HI"), help="dead band adc range")
+    parser.add_argument("--points", help="csv of adc,degrees calibration points")
+    args = parser.parse_args()
+
+    points = read_points(args.points) if args.points else []
+    table = build(args.north, args.dead_band, points)
+
+    description = "north %g" % args.north
+    if args.dead_band:
+        description += ", dead band %d-%d" % tuple(args.dead_band)
+    if points:
+        description += ", %d points" % len(points)
+
+    write_header(table, description, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
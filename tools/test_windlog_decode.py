@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+# ------------------------------------------------------------------------------------------------
+# Tests for windlog_decode.py.
+#
+# The dumps are built the same way src/windlog.cpp writes them.
+#
+#   python tools/test_windlog_decode.py
+# ------------------------------------------------------------------------------------------------
+import os
+import sys
+import unittest
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+
+import windlog_decode  # noqa: E402
+
+PAGE_SIZE = 32
+
+
+class logwriter:
+    """Writes records into pages as windlog::append() does."""
+
+    def __init__(self):
+        self.pages = []
+        self.page = bytearray()
+        self.last_t = None
+        self.resumed = False
+
+    def put(self, record):
+        if len(self.page) + len(record) > PAGE_SIZE - windlog_decode.PAGE_DATA:
+            self.store_page()
+        self.page += record
+
+    def store_page(self):
+        sequence = len(self.pages) % 254 + 1
+        self.pages.append(bytes([sequence, len(self.page)]) + bytes(self.page).ljust(PAGE_SIZE - 2, b"\0"))
+        self.page = bytearray()
+
+    def control(self, kind):
+        value = windlog_decode.CONTROL_SPEED | (kind << 12)
+        return bytes([value & 0xFF, value >> 8])
+
+    def append(self, t, speed, direction):
+        delta = 0 if self.last_t is None else t - self.last_t
+        if self.last_t is None:
+            self.put(self.control(windlog_decode.CONTROL_RESTART))
+        elif self.resumed or delta > 0x1FFFFF:
+            self.put(self.control(windlog_decode.CONTROL_TIME_BASE) + (delta & 0xFFFFFFFF).to_bytes(4, "little"))
+            delta = 0
+
+        self.last_t = t
+        self.resumed = False
+
+        value = speed | (direction << 12)
+        record = bytearray([value & 0xFF, value >> 8])
+        while delta >= 0x80:
+            record.append((delta & 0x7F) | 0x80)
+            delta >>= 7
+        record.append(delta)
+        self.put(record)
+
+    def dump(self, now):
+        """Return the lines of a dump taken at time now."""
+        pages = self.pages + [bytes([len(self.pages) % 254 + 1, len(self.page)]) +
+                              bytes(self.page).ljust(PAGE_SIZE - 2, b"\0")]
+        lines = ["windlog %d %d" % (len(pages), now - self.last_t)]
+        lines += [page.hex().upper() for page in pages]
+        lines.append("end")
+        return lines
+
+
+def decode(lines, now):
+    (age, pages), = windlog_decode.read_dumps(lines)
+    return windlog_decode.place_records(windlog_decode.decode_records(pages), now - age / 1000.0)
+
+
+class testwindlogdecode(unittest.TestCase):
+
+    def test_outages_either_side_of_a_long_online_stretch(self):
+        # Two outages of 10 minutes with 2 hours online between them, much longer than the
+        # 35 minutes a sample record's delta can hold.
+        log = logwriter()
+        times = []
+
+        for outage_start in (0, 10 * 60000 + 2 * 3600000):
+            log.resumed = True
+            for i in range(0, 10 * 60000, 2250):
+                t = outage_start + i
+                log.append(t, 50 + i % 7, i % 16)
+                times.append(t)
+
+        now = times[-1] + 1234
+        rows = decode(log.dump(now), now / 1000.0)
+
+        self.assertEqual(len(rows), len(times))
+        for (t, speed, direction), expected in zip(rows, times):
+            self.assertAlmostEqual(t, expected / 1000.0, places=3)
+
+    def test_zero_delta_is_a_sample(self):
+        log = logwriter()
+        for t in (1000, 1000, 3250):
+            log.append(t, 40, 2)
+
+        rows = decode(log.dump(4000), 4.0)
+        self.assertEqual([t for t, _, _ in rows], [1.0, 1.0, 3.25])
+
+    def test_records_before_a_restart_are_skipped(self):
+        log = logwriter()
+        log.append(1000, 40, 2)
+        log.append(3250, 41, 3)
+        log.last_t = None
+        log.append(500, 42, 4)
+
+        rows = decode(log.dump(500), 0.5)
+        self.assertEqual(rows, [(0.5, 4.2, 4)])
+
+    def test_records_before_a_dropped_page_are_skipped(self):
+        # Seven samples fit in a page, so the first two pages hold samples 0 to 13.
+        log = logwriter()
+        for i in range(40):
+            log.append(i * 2250, 40, 2)
+
+        # The EEPROM spill dropped the second page.
+        lines = log.dump(39 * 2250)
+        del lines[2]
+
+        rows = decode(lines, 39 * 2.25)
+        self.assertEqual([t for t, _, _ in rows], [i * 2.25 for i in range(14, 40)])
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+# ------------------------------------------------------------------------------------------------
+# Decode a flight recorder dump from the bridge.
+#
+# Send 't' to the bridge over the serial port and capture the output to a file, then run,
+#
+#   python tools/trace_decode.py capture.txt
+#
+# Each dump in the capture is rendered as a timeline. Times are relative to the first
+# record in the dump and the gap from the previous record is also shown.
+# ------------------------------------------------------------------------------------------------
+import argparse
+import sys
+
+# These must match the enums in the firmware.
+DAVIS6410_STATES = ["idle", "new_sample", "sampling_speed", "sampling_direction", "send_frame"]
+TX20_STATES = ["nothing", "disabled", "waking", "start_sample", "sampling", "waiting", "sending"]
+TX20_EVENTS = ["start_sample", "start_data_frame", "end_data_frame", "end_sample", "abort_sample"]
+
+
+def name(names, value):
+    return names[value] if value < len(names) else "?%d" % value
+
+
+# Formatters for each traceid, indexed by id.
+RECORD_FORMATTERS = [
+    lambda arg: "davis6410 -> " + name(DAVIS6410_STATES, arg),
+    lambda arg: "tx20 -> " + name(TX20_STATES, arg),
+    lambda arg: "tx20 event " + name(TX20_EVENTS, arg),
+    lambda arg: "dtr " + ("high" if arg else "low"),
+    lambda arg: "pulse debounce rejects %d" % arg,
+    lambda arg: "pulse counter overflow",
+]
+
+
+def read_dumps(lines):
+    """Yield the list of (t, id, arg) records for each dump in the capture."""
+    records = None
+    for line in lines:
+        fields = line.split()
+        if not fields:
+            continue
+        if fields[0] == "trace":
+            records = []
+        elif fields[0] == "end" and records is not None:
+            yield records
+            records = None
+        elif records is not None and len(fields) == 3:
+            records.append(tuple(int(f, 16) for f in fields))
+
+
+def render(records, out):
+    if not records:
+        out.write("(empty)\n")
+        return
+
+    t0 = records[0][0]
+    previous = t0
+    for t, record_id, arg in records:
+        # micros() wraps every 71 minutes, so all differences are taken modulo 2^32.
+        elapsed = (t - t0) & 0xFFFFFFFF
+        gap = (t - previous) & 0xFFFFFFFF
+        previous = t
+
+        if record_id < len(RECORD_FORMATTERS):
+            text = RECORD_FORMATTERS[record_id](arg)
+        else:
+            text = "unknown id %d arg %d" % (record_id, arg)
+
+        out.write("%12.3f ms  %+12.3f ms  %s\n" % (elapsed / 1000.0, gap / 1000.0, text))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode a bridge flight recorder dump.")
+    parser.add_argument("capture", nargs="?", help="serial capture file, stdin if omitted")
+    args = parser.parse_args()
+
+    lines = open(args.capture) if args.capture else sys.stdin
+
+    for n, records in enumerate(read_dumps(lines)):
+        sys.stdout.write("dump %d, %d records\n" % (n, len(records)))
+        render(records, sys.stdout)
+        sys.stdout.write("\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+# ------------------------------------------------------------------------------------------------
+# Decode a wind log dump from the bridge.
+#
+# Send 'l' to the bridge over the serial port and capture the output to a file, then run,
+#
+#   python tools/windlog_decode.py capture.txt [--now <unix time of the dump>]
+#
+# One csv line is written per logged sample,
+#
+#   time,speed_ms,direction
+#
+# The time is in seconds relative to the dump, or a unix time if --now is given. Samples
+# logged before the bridge restarted, or before a page missing from the log, can't be
+# placed in time and are skipped.
+# See src/windlog.h for the format of the pages.
+# ------------------------------------------------------------------------------------------------
+import argparse
+import sys
+
+PAGE_DATA = 2
+
+# Page sequence numbers run from 1 to MAX_SEQUENCE.
+MAX_SEQUENCE = 254
+
+# A speed of CONTROL_SPEED marks a control record, the kind is in the direction bits.
+CONTROL_SPEED = 0xFFF
+CONTROL_RESTART = 0
+CONTROL_TIME_BASE = 1
+
+
+def read_dumps(lines):
+    """Yield (ms since last record, [page bytes]) for each dump in the capture."""
+    pages = None
+    age = 0
+    for line in lines:
+        fields = line.split()
+        if not fields:
+            continue
+        if fields[0] == "windlog" and len(fields) in (3, 4):
+            pages = []
+            age = int(fields[2])
+            if len(fields) == 4 and int(fields[3]):
+                sys.stderr.write("windlog: %s pages were dropped by the EEPROM spill\n" % fields[3])
+        elif fields[0] == "end" and pages is not None:
+            yield age, pages
+            pages = None
+        elif pages is not None:
+            pages.append(bytes.fromhex(fields[0]))
+
+
+def decode_records(pages):
+    """Return a list of records, oldest first.
+
+    A sample is ("sample", delta ms, speed units, direction), a time base is
+    ("time_base", delta ms) and a restart is ("restart",). A gap in the page sequence,
+    where a page was dropped, is also a restart.
+    """
+    records = []
+    sequence = None
+    for page in pages:
+        if page[0] in (0, 0xFF):
+            continue
+
+        if sequence is not None and page[0] != sequence % MAX_SEQUENCE + 1:
+            records.append(("restart",))
+        sequence = page[0]
+
+        data = page[PAGE_DATA:PAGE_DATA + page[1]]
+        i = 0
+        while i + 2 <= len(data):
+            value = data[i] | (data[i + 1] << 8)
+            i += 2
+
+            if value & 0xFFF == CONTROL_SPEED:
+                if value >> 12 == CONTROL_TIME_BASE:
+                    records.append(("time_base", int.from_bytes(data[i:i + 4], "little")))
+                    i += 4
+                else:
+                    records.append(("restart",))
+                continue
+
+            delta = 0
+            shift = 0
+            while True:
+                b = data[i]
+                i += 1
+                delta |= (b & 0x7F) << shift
+                shift += 7
+                if not b & 0x80:
+                    break
+
+            records.append(("sample", delta, value & 0xFFF, value >> 12))
+    return records
+
+
+def place_records(records, end):
+    """Return (time, speed m/s, direction) for each sample, oldest first.
+
+    The newest record is at time end. The samples are placed by working back through the
+    deltas, stopping at the last restart.
+    """
+    t = end
+    rows = []
+    for record in reversed(records):
+        if record[0] == "restart":
+            break
+        if record[0] == "sample":
+            rows.append((t, record[2] / 10.0, record[3]))
+        t -= record[1] / 1000.0
+    rows.reverse()
+    return rows
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode a bridge wind log dump.")
+    parser.add_argument("capture", nargs="?", help="serial capture file, stdin if omitted")
+    parser.add_argument("--now", type=float, default=0.0, help="unix time the dump was taken")
+    args = parser.parse_args()
+
+    lines = open(args.capture) if args.capture else sys.stdin
+
+    out = sys.stdout
+    out.write("time,speed_ms,direction\n")
+
+    for age, pages in read_dumps(lines):
+        for t, speed, direction in place_records(decode_records(pages), args.now - age / 1000.0):
+            out.write("%.3f,%.1f,%d\n" % (t, speed, direction))
+
+
+if __name__ == "__main__":
+    main()